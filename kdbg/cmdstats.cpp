@@ -0,0 +1,90 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "cmdstats.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+
+void CommandStatistics::Histogram::add(qint64 usecs)
+{
+    if (usecs < 0)
+	usecs = 0;
+    // bucket i holds durations below 2^i microseconds
+    int i = 0;
+    while (i < numBuckets-1 && (qint64(1) << i) <= usecs)
+	i++;
+    m_buckets[i]++;
+    m_count++;
+    m_total += usecs;
+    if (usecs > m_max)
+	m_max = usecs;
+}
+
+qint64 CommandStatistics::Histogram::percentile(int p) const
+{
+    if (m_count == 0)
+	return 0;
+    // the rank of the sample that we are looking for, rounded up
+    unsigned rank = (unsigned(m_count) * p + 99) / 100;
+    if (rank == 0)
+	rank = 1;
+    unsigned seen = 0;
+    for (int i = 0; i < numBuckets; i++) {
+	seen += m_buckets[i];
+	if (seen >= rank)
+	    return std::min(qint64(1) << i, m_max);
+    }
+    return m_max;
+}
+
+void CommandStatistics::record(int cmd, const QString& name, qint64 queued,
+			       qint64 written, qint64 committed,
+			       qint64 answered, qint64 finished,
+			       int outputBytes)
+{
+    m_changes++;
+    Entry& e = m_entries[cmd];
+    if (e.name.isEmpty())
+	e.name = name;
+    e.count++;
+    e.outputBytes += outputBytes;
+    e.wait.add((written - queued) / 1000);
+    e.debugger.add((answered - committed) / 1000);
+    e.parse.add((finished - answered) / 1000);
+}
+
+static QJsonObject histogramToJson(const CommandStatistics::Histogram& h)
+{
+    QJsonObject o;
+    o[QLatin1String("p50_us")] = h.percentile(50);
+    o[QLatin1String("p99_us")] = h.percentile(99);
+    o[QLatin1String("max_us")] = h.max();
+    o[QLatin1String("total_us")] = h.total();
+    return o;
+}
+
+QByteArray CommandStatistics::toJson() const
+{
+    QJsonArray cmds;
+    for (const auto& e : m_entries)
+    {
+	QJsonObject o;
+	o[QLatin1String("id")] = e.first;
+	o[QLatin1String("command")] = e.second.name;
+	o[QLatin1String("count")] = int(e.second.count);
+	o[QLatin1String("output_bytes")] = e.second.outputBytes;
+	o[QLatin1String("wait")] = histogramToJson(e.second.wait);
+	o[QLatin1String("debugger")] = histogramToJson(e.second.debugger);
+	o[QLatin1String("parse")] = histogramToJson(e.second.parse);
+	cmds.append(o);
+    }
+    QJsonObject doc;
+    doc[QLatin1String("commands")] = cmds;
+    return QJsonDocument(doc).toJson();
+}
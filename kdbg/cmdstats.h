@@ -0,0 +1,71 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef CMDSTATS_H
+#define CMDSTATS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <map>
+
+/**
+ * Collects the latencies of the commands that were sent to the debugger,
+ * grouped by command kind.
+ *
+ * Durations are recorded in a histogram with power-of-two buckets of
+ * microseconds, so that the memory needed does not depend on the number
+ * of commands. Percentiles are reported as the upper bound of the bucket
+ * in which they fall.
+ */
+class CommandStatistics
+{
+public:
+    class Histogram
+    {
+    public:
+	enum { numBuckets = 32 };	/* up to about 35 minutes */
+	void add(qint64 usecs);
+	/** Returns the upper bound in microseconds of the p-th percentile */
+	qint64 percentile(int p) const;
+	qint64 total() const { return m_total; }
+	qint64 max() const { return m_max; }
+    private:
+	unsigned m_buckets[numBuckets] = {};
+	unsigned m_count = 0;
+	qint64 m_total = 0;
+	qint64 m_max = 0;
+    };
+
+    struct Entry
+    {
+	QString name;			/* describes the command */
+	unsigned count = 0;
+	qint64 outputBytes = 0;
+	Histogram wait;			/* from enqueuing until sent */
+	Histogram debugger;		/* from received until the prompt */
+	Histogram parse;		/* handling of the output */
+    };
+
+    /**
+     * Records a command. The times are nanoseconds of the same clock.
+     */
+    void record(int cmd, const QString& name, qint64 queued, qint64 written,
+		qint64 committed, qint64 answered, qint64 finished,
+		int outputBytes);
+    void clear() { m_entries.clear(); m_changes++; }
+    const std::map<int,Entry>& entries() const { return m_entries; }
+    /** Counts the changes; tells whether the entries must be shown anew */
+    unsigned changes() const { return m_changes; }
+    /** Returns the statistics as a JSON document */
+    QByteArray toJson() const;
+
+private:
+    std::map<int,Entry> m_entries;	/* indexed by DbgCommand */
+    unsigned m_changes = 0;
+};
+
+#endif // CMDSTATS_H
@@ -6,6 +6,7 @@
 
 #include "dbgdriver.h"
 #include "exprwnd.h"
+#include "transcript.h"
 #include <ctype.h>
 #include <signal.h>
 #include <stdlib.h>			/* strtol, atoi */
@@ -17,6 +18,10 @@
 DebuggerDriver::DebuggerDriver() :
 	m_state(DSidle)
 {
+    // reserve() keeps the capacity when the buffer is emptied
+    m_output.reserve(16*1024);
+    m_clock.start();
+
     // debugger process
     connect(this, SIGNAL(readyReadStandardOutput()), SLOT(slotReceiveOutput()));
     connect(this, SIGNAL(bytesWritten(qint64)), SLOT(slotCommandRead()));
@@ -28,6 +33,8 @@ DebuggerDriver::~DebuggerDriver()
 {
     flushHiPriQueue();
     flushLoPriQueue();
+    flushPipeline();
+    delete m_recorder;
 }
 
 
@@ -38,6 +45,7 @@ bool DebuggerDriver::startup(QString cmdStr)
     m_activeCmd = nullptr;
     flushHiPriQueue();
     flushLoPriQueue();
+    flushPipeline();
     m_state = DSidle;
 
     // debugger executable
@@ -66,10 +74,35 @@ bool DebuggerDriver::startup(QString cmdStr)
 	m_logFile.setFileName(m_logFileName);
 	m_logFile.open(QIODevice::WriteOnly);
     }
+    if (!m_recorder && !m_recordFileName.isEmpty()) {
+	m_recorder = new TranscriptWriter(m_recordFileName);
+    }
 
     return true;
 }
 
+static void addRecord(TranscriptWriter* recorder, TranscriptRecord::Type type,
+		      qint64 time, const CmdQueueItem* cmd,
+		      const char* data, int len)
+{
+    TranscriptRecord rec;
+    rec.type = type;
+    rec.time = time;
+    rec.cmd = cmd ? cmd->m_cmd : -1;
+    if (cmd)
+	rec.command = cmd->m_cmdString.toUtf8();
+    rec.payload = QByteArray(data, len);
+    recorder->write(rec);
+}
+
+void DebuggerDriver::recordResult(const CmdQueueItem* cmd)
+{
+    if (m_recorder) {
+	addRecord(m_recorder, TranscriptRecord::RTresult, m_clock.nsecsElapsed(),
+		  cmd, m_output.constData(), m_output.size());
+    }
+}
+
 void DebuggerDriver::slotExited()
 {
     static const char txt[] = "\n====== debugger exited ======\n";
@@ -80,7 +113,7 @@ void DebuggerDriver::slotExited()
     // reset state
     m_state = DSidle;
     // empty buffer
-    m_output.clear();
+    resetOutput();
 }
 
 
@@ -89,10 +122,26 @@ CmdQueueItem* DebuggerDriver::executeCmdString(DbgCommand cmd,
 {
     // place a new command into the high-priority queue
     CmdQueueItem* cmdItem = new CmdQueueItem(cmd, cmdString);
+    cmdItem->m_generation = m_generation;
+    cmdItem->m_tQueued = m_clock.nsecsElapsed();
     m_hipriCmdQueue.push(cmdItem);
 
     if (clearLow) {
-	if (m_state == DSrunningLow) {
+	/*
+	 * Commands that are queued while this one is waiting or running
+	 * are for the current stop and become stale, too.
+	 */
+	cmdItem->m_newGeneration = true;
+	if (m_state == DSrunningLow && !m_pipelineCmds.empty()) {
+	    /*
+	     * More commands are on their way to gdb. An interrupt would
+	     * leave us unsure which output belongs to which command;
+	     * let them finish, but ignore their output.
+	     */
+	    ASSERT(m_activeCmd);
+	    if (m_activeCmd)
+		m_activeCmd->m_discard = true;
+	} else if (m_state == DSrunningLow) {
 	    // take the liberty to interrupt the running command
 	    m_state = DSinterrupted;
 	    ::kill(processId(), SIGINT);
@@ -128,16 +177,22 @@ CmdQueueItem* DebuggerDriver::queueCmdString(DbgCommand cmd,
     case QMoverrideMoreEqual:
     case QMoverride:
 	// check whether gdb is currently processing this command
-	if (m_activeCmd &&
+	if (m_activeCmd && !m_activeCmd->m_discard &&
 	    m_activeCmd->m_cmd == cmd && m_activeCmd->m_cmdString == cmdString)
 	{
 	    return m_activeCmd;
 	}
+	// or whether it was sent to gdb together with the active command
+	for (CmdQueueItem* sent : m_pipelineCmds) {
+	    if (!sent->m_discard && CmdQueueItem::IsEqualCmd(cmd, cmdString)(sent))
+		return sent;
+	}
 	// check whether there is already the same command in the queue
 	i = find_if(m_lopriCmdQueue.begin(), m_lopriCmdQueue.end(), CmdQueueItem::IsEqualCmd(cmd, cmdString));
 	if (i != m_lopriCmdQueue.end()) {
 	    // found one
 	    cmdItem = *i;
+	    cmdItem->m_generation = m_generation;
 	    if (mode == QMoverrideMoreEqual) {
 		// All commands are equal, but some are more equal than others...
 		// put this command in front of all others
@@ -149,6 +204,8 @@ CmdQueueItem* DebuggerDriver::queueCmdString(DbgCommand cmd,
 	// fall through
     case QMnormal:
 	cmdItem = new CmdQueueItem(cmd, cmdString);
+	cmdItem->m_generation = m_generation;
+	cmdItem->m_tQueued = m_clock.nsecsElapsed();
 	m_lopriCmdQueue.push_back(cmdItem);
     }
 
@@ -185,8 +242,40 @@ void DebuggerDriver::writeCommand()
 
     m_activeCmd = cmd;
     TRACE("in writeCommand: " + cmd->m_cmdString);
+    cmd->m_tWritten = m_clock.nsecsElapsed();
+    if (m_recorder) {
+	addRecord(m_recorder, TranscriptRecord::RTcommand, cmd->m_tWritten,
+		  cmd, nullptr, 0);
+    }
 
-    QByteArray str = cmd->m_cmdString.toLocal8Bit();
+    /*
+     * Send more low-priority commands along with this one if neither
+     * depends on the outcome of the other.
+     */
+    if (newState == DScommandSentLow && canPipeline(cmd)) {
+	while (int(m_pipelineCmds.size()) + 1 < m_pipelineDepth &&
+	       !m_lopriCmdQueue.empty() && canPipeline(m_lopriCmdQueue.front()))
+	{
+	    cmd = m_lopriCmdQueue.front();
+	    m_lopriCmdQueue.pop_front();
+	    m_pipelineCmds.push_back(cmd);
+	    TRACE("pipelined: " + cmd->m_cmdString);
+	    cmd->m_tWritten = m_activeCmd->m_tWritten;
+	    if (m_recorder) {
+		addRecord(m_recorder, TranscriptRecord::RTcommand,
+			  cmd->m_tWritten, cmd, nullptr, 0);
+	    }
+	}
+    }
+    if (!m_pipelineCmds.empty()) {
+	// tell apart the outputs of the commands
+	m_activeCmd->m_pipelineMark = ++m_lastPipelineMark;
+	for (CmdQueueItem* sent : m_pipelineCmds)
+	    sent->m_pipelineMark = ++m_lastPipelineMark;
+    }
+    QByteArray str = encodeCommand(m_activeCmd);
+    for (CmdQueueItem* sent : m_pipelineCmds)
+	str += encodeCommand(sent);
     const char* data = str.data();
     qint64 len = str.length();
     while (len > 0) {
@@ -206,12 +295,91 @@ void DebuggerDriver::writeCommand()
     m_state = newState;
 }
 
+QByteArray DebuggerDriver::encodeCommand(CmdQueueItem* cmd)
+{
+    return cmd->m_cmdString.toLocal8Bit();
+}
+
+bool DebuggerDriver::canPipeline(const CmdQueueItem*) const
+{
+    return false;
+}
+
+QString DebuggerDriver::commandName(DbgCommand cmd) const
+{
+    return QString::number(cmd);
+}
+
 void DebuggerDriver::flushLoPriQueue()
 {
     while (!m_lopriCmdQueue.empty()) {
 	delete m_lopriCmdQueue.back();
 	m_lopriCmdQueue.pop_back();
     }
+    // the pipelined commands cannot be recalled; ignore their output
+    for (CmdQueueItem* cmd : m_pipelineCmds) {
+	cmd->m_discard = true;
+    }
+}
+
+/*
+ * Commands that inspect the state of the stopped program; their output is
+ * useless after the program has moved on. Other commands, e.g., the
+ * refresh of the breakpoint list after an edit, are still needed.
+ */
+static bool inspectsProgramState(DbgCommand cmd)
+{
+    switch (cmd) {
+    case DCinfolocals:
+    case DCinforegisters:
+    case DCexamine:
+    case DCprint:
+    case DCprintDeref:
+    case DCprintStruct:
+    case DCprintQStringStruct:
+    case DCprintPopup:
+    case DCprintWChar:
+    case DCprintStructBatch:
+    case DCprintSlice:
+    case DCfindType:
+	return true;
+    default:
+	return false;
+    }
+}
+
+void DebuggerDriver::startGeneration()
+{
+    ++m_generation;
+
+    auto stale = [this](CmdQueueItem* cmd) {
+	if (cmd->m_generation == m_generation ||
+	    !inspectsProgramState(cmd->m_cmd))
+	{
+	    return false;
+	}
+	TRACE("dropping stale command: " + cmd->m_cmdString);
+	delete cmd;
+	return true;
+    };
+    m_lopriCmdQueue.remove_if(stale);
+
+    // stale commands that were already sent cannot be recalled
+    for (CmdQueueItem* cmd : m_pipelineCmds) {
+	if (cmd->m_generation != m_generation &&
+	    inspectsProgramState(cmd->m_cmd))
+	{
+	    cmd->m_discard = true;
+	}
+    }
+}
+
+void DebuggerDriver::flushPipeline()
+{
+    while (!m_pipelineCmds.empty()) {
+	delete m_pipelineCmds.back();
+	m_pipelineCmds.pop_back();
+    }
 }
 
 void DebuggerDriver::flushHiPriQueue()
@@ -240,7 +408,13 @@ void DebuggerDriver::slotCommandRead()
     ASSERT(!m_activeCmd->m_committed);
 
     // commit the command
+    qint64 now = m_clock.nsecsElapsed();
     m_activeCmd->m_committed = true;
+    m_activeCmd->m_tCommitted = now;
+    for (CmdQueueItem* cmd : m_pipelineCmds) {
+	cmd->m_committed = true;
+	cmd->m_tCommitted = now;
+    }
 
     // now the debugger is officially working on the command
     m_state = m_state == DScommandSent ? DSrunning : DSrunningLow;
@@ -254,18 +428,12 @@ void DebuggerDriver::slotCommandRead()
 	break;
     }
 
-    // process delayed output
-    while (!m_delayedOutput.empty()) {
-	QByteArray delayed = m_delayedOutput.front();
-	m_delayedOutput.pop();
-	processOutput(delayed);
-    }
+    // process output that arrived before the acknowledgment
+    readOutput();
 }
 
 void DebuggerDriver::slotReceiveOutput()
 {
-    QByteArray data = readAllStandardOutput();
-
     /*
      * The debugger should be running (processing a command) at this point.
      * If it is not, it is still idle because we haven't received the
@@ -276,23 +444,50 @@ void DebuggerDriver::slotReceiveOutput()
 	ASSERT(m_activeCmd);
 	ASSERT(!m_activeCmd->m_committed);
 	/*
-	 * We received output before we got signal bytesWritten. Collect this
-	 * output, it will be processed by commandRead when it gets the
+	 * We received output before we got signal bytesWritten. Leave it
+	 * where it is, it will be processed by commandRead when it gets the
 	 * acknowledgment for the uncommitted command.
 	 */
-	m_delayedOutput.push(data);
 	return;
     }
-    processOutput(data);
+    readOutput();
+}
+
+void DebuggerDriver::readOutput()
+{
+    qint64 avail = bytesAvailable();
+    if (avail <= 0)
+	return;
+
+    // read directly behind the output collected so far
+    int oldSize = m_output.size();
+    m_output.resize(oldSize + int(avail));
+    qint64 n = read(m_output.data() + oldSize, avail);
+    m_output.resize(oldSize + int(std::max(n, qint64(0))));
+
+    processOutput(oldSize);
 }
 
-void DebuggerDriver::processOutput(const QByteArray& data)
+void DebuggerDriver::resetOutput(const char* rest, int restLen)
 {
-    // write to log file (do not log delayed output - it would appear twice)
+    m_output.resize(0);
+    if (restLen > 0)
+	m_output.append(rest, restLen);
+    if (m_output.capacity() < 16*1024)
+	m_output.reserve(16*1024);	/* was lost by an assignment */
+}
+
+void DebuggerDriver::processOutput(int newStart)
+{
+    // write to log file
     if (m_logFile.isOpen()) {
-	m_logFile.write(data);
+	m_logFile.write(m_output.constData()+newStart, m_output.size()-newStart);
 	m_logFile.flush();
     }
+    if (m_recorder) {
+	addRecord(m_recorder, TranscriptRecord::RToutput, m_clock.nsecsElapsed(),
+		  nullptr, m_output.constData()+newStart, m_output.size()-newStart);
+    }
     
     /*
      * gdb sometimes produces stray output while it's idle. This happens if
@@ -302,24 +497,31 @@ void DebuggerDriver::processOutput(const QByteArray& data)
      */
     if (!m_activeCmd && m_state != DSinterrupted) {
 	// ignore the output
-	TRACE("ignoring stray output: " + QString(data));
+	TRACE("ignoring stray output: " + QString::fromLocal8Bit(m_output.constData()+newStart));
+	m_output.resize(newStart);
 	return;
     }
     ASSERT(m_state == DSrunning || m_state == DSrunningLow || m_state == DSinterrupted);
     ASSERT(m_activeCmd || m_state == DSinterrupted);
 
     // collect output until next prompt string is found
-    
-    // accumulate it
-    m_output += data;
 
-    // check for a prompt
-    int promptStart = findPrompt(m_output);
-    if (promptStart >= 0)
+    // check for a prompt, but look only at the new data
+    int promptEnd;
+    int promptStart;
+    while ((promptStart = findPrompt(m_output, newStart, promptEnd)) >= 0)
     {
 	// found prompt!
+	qint64 answered = m_clock.nsecsElapsed();
 
-	// terminate output before the prompt
+	/*
+	 * The output after the prompt belongs to the next pipelined
+	 * command. Hide it from the parsers by terminating the output
+	 * before the prompt; this needs a copy only if it is not empty.
+	 */
+	QByteArray rest;
+	if (promptEnd < m_output.size())
+	    rest = QByteArray(m_output.constData()+promptEnd, m_output.size()-promptEnd);
 	m_output.resize(promptStart);
 
 	/*
@@ -335,31 +537,50 @@ void DebuggerDriver::processOutput(const QByteArray& data)
 	    ASSERT(m_state != DSidle);
 	    CmdQueueItem* cmd = m_activeCmd;
 	    m_activeCmd = nullptr;
-	    commandFinished(cmd);
+	    // the commands queued while parsing belong to the new stop
+	    if (cmd->m_newGeneration)
+		startGeneration();
+	    if (!cmd->m_discard) {
+		int outputBytes = m_output.size();
+		cmd->m_tAnswered = answered;
+		commandFinished(cmd);
+		m_statistics.record(cmd->m_cmd, commandName(cmd->m_cmd),
+				    cmd->m_tQueued, cmd->m_tWritten,
+				    cmd->m_tCommitted, cmd->m_tAnswered,
+				    m_clock.nsecsElapsed(),
+				    outputBytes);
+	    }
 	    delete cmd;
 	}
 
-	// empty buffer
-	m_output.clear();
-	// also clear delayed output if interrupted
-	if (m_state == DSinterrupted) {
-	    m_delayedOutput = std::queue<QByteArray>();
+	// continue with the next command that was sent along
+	if (!m_pipelineCmds.empty()) {
+	    m_activeCmd = m_pipelineCmds.front();
+	    m_pipelineCmds.pop_front();
+	    // the debugger turned to this command only now
+	    m_activeCmd->m_tCommitted = std::max(m_activeCmd->m_tCommitted, answered);
+	    if (m_state == DSinterrupted)
+		m_state = DSrunningLow;
+	    resetOutput(rest.constData(), rest.size());
+	    newStart = 0;
+	    continue;
 	}
 
+	// empty buffer
+	resetOutput();
+
 	/*
-	 * We parsed some output successfully. Unless there's more delayed
-	 * output, the debugger must be idle now, so send down the next
-	 * command.
+	 * We parsed some output successfully. The debugger must be idle
+	 * now, so send down the next command.
 	 */
-	if (m_delayedOutput.empty()) {
-	    if (m_hipriCmdQueue.empty() && m_lopriCmdQueue.empty()) {
-		// no pending commands
-		m_state = DSidle;
-		Q_EMIT enterIdleState();
-	    } else {
-		writeCommand();
-	    }
+	if (m_hipriCmdQueue.empty() && m_lopriCmdQueue.empty()) {
+	    // no pending commands
+	    m_state = DSidle;
+	    Q_EMIT enterIdleState();
+	} else {
+	    writeCommand();
 	}
+	break;
     }
 }
 
@@ -378,8 +599,26 @@ void DebuggerDriver::dequeueCmdByVar(VarTree* var)
 	} else
 	    ++i;
     }
+    // commands that were already sent must not get their output
+    for (CmdQueueItem* cmd : m_pipelineCmds) {
+	if (cmd->m_expr && var->isAncestorEq(cmd->m_expr)) {
+	    TRACE("discarding pipelined cmd: " + cmd->m_cmdString);
+	    cmd->m_discard = true;
+	    cmd->m_expr = nullptr;
+	}
+    }
+}
+
+
+bool DebuggerDriver::canBatchStructExprs() const
+{
+    return false;
 }
 
+QString DebuggerDriver::parseMissingSymbol(const char*)
+{
+    return QString();
+}
 
 QString DebuggerDriver::editableValue(VarTree* value)
 {
@@ -9,16 +9,20 @@
 
 #include <QFile>
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QProcess>
 #include <QStringList>
 #include <queue>
 #include <list>
+#include "cmdstats.h"
 
 
 class VarTree;
 struct ExprValue;
 class ExprWnd;
 class KDebugger;
+class TranscriptWriter;
 
 
 /**
@@ -96,7 +100,11 @@ enum DbgCommand {
 	DCsetpc,
 	DCignore,
 	DCprintWChar,
-	DCsetvariable
+	DCsetvariable,
+	DCdefineStruct,			/* define command for DCprintStructBatch */
+	DCprintStructBatch,
+	DCprintSlice,			/* elements of an array beyond gdb's limit */
+	DCdisassembleFunc		/* the function containing an address */
 };
 
 enum RunDevNull {
@@ -134,18 +142,32 @@ enum MemoryDumpType {
 struct Breakpoint;
 
 /**
- * Debugger commands are placed in a queue. Only one command at a time is
- * sent down to the debugger. All other commands in the queue are retained
- * until the sent command has been processed by gdb. The debugger tells us
- * that it's done with the command by sending the prompt. The output of the
- * debugger is parsed at that time. Then, if more commands are in the
- * queue, the next one is sent to the debugger.
+ * Debugger commands are placed in a queue. Usually, only one command at a
+ * time is sent down to the debugger. All other commands in the queue are
+ * retained until the sent command has been processed by gdb. The debugger
+ * tells us that it's done with the command by sending the prompt. The
+ * output of the debugger is parsed at that time. Then, if more commands
+ * are in the queue, the next one is sent to the debugger.
+ *
+ * Low-priority commands that only inspect the program can be pipelined:
+ * several of them are sent in one go, and their outputs are assigned to
+ * them in order. Each of them is followed by a unique mark, because the
+ * output of a command could contain a string that looks like the prompt.
  */
 struct CmdQueueItem
 {
     DbgCommand m_cmd;
     QString m_cmdString;
     bool m_committed;			/* just a debugging aid */
+    bool m_discard = false;		/* already sent, but the output is not needed */
+    unsigned m_generation = 0;		/* the stop for which it was queued */
+    unsigned m_pipelineMark = 0;	/* ends its output in a pipeline; 0 if none */
+    bool m_newGeneration = false;	/* runs the program; stops anew */
+    // when the command was queued, sent, and answered (nanoseconds)
+    qint64 m_tQueued = 0;
+    qint64 m_tWritten = 0;
+    qint64 m_tCommitted = 0;
+    qint64 m_tAnswered = 0;
     // remember which expression when printing an expression
     VarTree* m_expr = nullptr;
     ExprWnd* m_exprWnd = nullptr;
@@ -220,6 +242,7 @@ struct FrameInfo
 struct StackFrame : FrameInfo
 {
     int frameNo;
+    QString function;			/* without arguments and location */
     ExprValue* var = nullptr;		/* more information if non-zero */
     StackFrame() = default;
     ~StackFrame();
@@ -289,7 +312,25 @@ public:
 
     virtual bool startup(QString cmdStr);
     void setLogFileName(const QString& fname) { m_logFileName = fname; }
+    /**
+     * Sets the file where the session is recorded for a later replay.
+     */
+    void setRecordFileName(const QString& fname) { m_recordFileName = fname; }
+    /**
+     * Sets how many low-priority commands may be sent to the debugger
+     * before the output of the first one has arrived.
+     */
+    void setPipelineDepth(int depth) { m_pipelineDepth = depth; }
     bool isRunning() { return state() != NotRunning; }
+    /**
+     * Returns how long the commands took, by command kind.
+     */
+    const CommandStatistics& statistics() const { return m_statistics; }
+    void clearStatistics() { m_statistics.clear(); }
+    /**
+     * Returns a short description of the command kind for the statistics.
+     */
+    virtual QString commandName(DbgCommand cmd) const;
 
 protected:
     QString m_runCmd;
@@ -312,8 +353,13 @@ public:
     bool canExecuteImmediately() const { return m_hipriCmdQueue.empty(); }
 
 protected:
-    QByteArray m_output;		// normal gdb output
-    std::queue<QByteArray> m_delayedOutput;	// output colleced before signal bytesWritten() arrived
+    /**
+     * The output of the active command. Data are read from the process
+     * directly into this buffer, which keeps its capacity across commands.
+     * Output that arrives before signal bytesWritten() is left in the
+     * buffer of QProcess until the command is committed.
+     */
+    QByteArray m_output;
 
 public:
     /**
@@ -460,8 +506,13 @@ public:
      * @param output The output of the debugger.
      * @param newVars Receives the parsed variable values. The values are
      * simply append()ed to the supplied list.
+     * @param printed On input, the printed values of the variables that
+     * are currently displayed. A variable whose text did not change is not
+     * parsed; it is returned without a value and with
+     * ExprValue::m_unchanged set. On output, the texts of the new values.
      */
-    virtual void parseLocals(const char* output, std::list<ExprValue*>& newVars) = 0;
+    virtual void parseLocals(const char* output, std::list<ExprValue*>& newVars,
+			     QHash<QString,QByteArray>& printed) = 0;
 
     /**
      * Parses the output of a DCprint or DCprintStruct command.
@@ -475,6 +526,14 @@ public:
      */
     virtual ExprValue* parsePrintExpr(const char* output, bool wantErrorValue) = 0;
 
+    /**
+     * Checks whether the output of a DCprint command says that a symbol
+     * of the expression is unknown in the current scope.
+     * @return the name of the symbol, or an empty string if the output
+     * is not such an error message.
+     */
+    virtual QString parseMissingSymbol(const char* output);
+
     /**
      * Parses the output of the DCcd command.
      * @return false if the message is an error message.
@@ -513,6 +572,20 @@ public:
      */
     virtual QStringList parseSharedLibs(const char* output) = 0;
 
+    /**
+     * Tells whether the debugger can evaluate all expressions of a type
+     * with one DCprintStructBatch command.
+     */
+    virtual bool canBatchStructExprs() const;
+
+    /**
+     * Parses the output of the DCprintStructBatch command.
+     * @param values Receives the values of the expressions in order. An
+     * expression that resulted in an error gets a null pointer, and the
+     * values of the expressions after it are missing.
+     */
+    virtual void parseStructBatch(const char* output, std::list<ExprValue*>& values) = 0;
+
     /**
      * Parses the output of the DCfindType command.
      * @return true if a type was found.
@@ -537,7 +610,7 @@ public:
     virtual QString parseInfoTarget(const char* output) = 0;
 
     /**
-     * Parses the ouput of the DCdisassemble command.
+     * Parses the ouput of the DCdisassemble and DCdisassembleFunc commands.
      */
     virtual std::list<DisassembledCode> parseDisassemble(const char* output) = 0;
 
@@ -577,6 +650,33 @@ protected:
      * The active command is kept separately from other pending commands.
      */
     CmdQueueItem* m_activeCmd = {};
+    /**
+     * Commands that were sent together with the active command and whose
+     * output follows that of the active command, in order.
+     */
+    std::list<CmdQueueItem*> m_pipelineCmds;
+    int m_pipelineDepth = 1;
+    unsigned m_lastPipelineMark = 0;	/* see CmdQueueItem::m_pipelineMark */
+    /**
+     * Counts the stops of the program. Low-priority commands that were
+     * queued before the last stop are stale.
+     */
+    unsigned m_generation = 0;
+    /** The clock for the time stamps of the commands */
+    QElapsedTimer m_clock;
+    CommandStatistics m_statistics;
+    /**
+     * Tells whether \a cmd may be sent to the debugger while the output
+     * of earlier commands has not yet arrived. The default is false.
+     */
+    virtual bool canPipeline(const CmdQueueItem* cmd) const;
+    /** Deletes the commands in the pipeline. */
+    void flushPipeline();
+    /**
+     * Is called when the program stopped anew. Drops the low-priority
+     * commands that were queued to inspect the previous stop.
+     */
+    void startGeneration();
     /**
      * Helper function that queues the given command string in the
      * low-priority queue.
@@ -590,6 +690,13 @@ protected:
     CmdQueueItem* executeCmdString(DbgCommand cmd, QString cmdString,
 				   bool clearLow);
     void writeCommand();
+    /**
+     * Returns the bytes that must be written to the debugger to run the
+     * command \a cmd. The default sends the command string as is.
+     * Drivers that can pipeline commands must also request the mark
+     * CmdQueueItem::m_pipelineMark if it is set.
+     */
+    virtual QByteArray encodeCommand(CmdQueueItem* cmd);
     virtual void commandFinished(CmdQueueItem* cmd) = 0;
     virtual QString makeCmdString(DbgCommand cmd) = 0;
     virtual QString makeCmdString(DbgCommand cmd, QString strArg) = 0;
@@ -600,18 +707,42 @@ protected:
     virtual QString makeCmdString(DbgCommand cmd, QString strArg, int intArg1, int intArg2) = 0;
 
 protected:
-    void processOutput(const QByteArray& data);
+    /**
+     * Appends the available output of the debugger to m_output and
+     * processes it.
+     */
+    void readOutput();
+    /**
+     * Looks for prompts in m_output, whose bytes from \a newStart on
+     * have not been looked at before.
+     */
+    void processOutput(int newStart);
+    /**
+     * Empties m_output without releasing its memory.
+     */
+    void resetOutput(const char* rest = nullptr, int restLen = 0);
 
     /**
-     * Returns the start of the prompt in \a output or -1.
-     * \a len specifies the size of \a output, but in addition, the contents
-     * of \a output are NUL-terminated, i.e., \c output[len] is zero.
+     * Returns the start of the first prompt in \a output or -1. The
+     * contents of \a output are NUL-terminated. \a promptEnd receives
+     * the offset after the prompt, where the output of the next pipelined
+     * command begins.
+     * @param scanFrom The size of \a output when it was last scanned
+     * without finding a prompt; only the data after it are new. The
+     * prompt itself may have started earlier, though.
      */
-    virtual int findPrompt(const QByteArray& output) const = 0;
+    virtual int findPrompt(const QByteArray& output, int scanFrom, int& promptEnd) const = 0;
 
     // log file
     QString m_logFileName;
     QFile m_logFile;
+    // record of the session, see ReplayDriver
+    QString m_recordFileName;
+    TranscriptWriter* m_recorder = nullptr;
+    /**
+     * Records the output of \a cmd as it is handed to the parsers.
+     */
+    void recordResult(const CmdQueueItem* cmd);
 
 public Q_SLOTS:
     void dequeueCmdByVar(VarTree* var);
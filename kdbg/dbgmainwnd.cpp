@@ -39,12 +39,16 @@
 #include "brkpt.h"
 #include "threadlist.h"
 #include "memwindow.h"
+#include "disasswnd.h"
+#include "statwindow.h"
 #include "ttywnd.h"
 #include "watchwindow.h"
 #include "procattach.h"
 #include "prefdebugger.h"
 #include "prefmisc.h"
 #include "gdbdriver.h"
+#include "gdbmidriver.h"
+#include "replaydriver.h"
 #include "mydebug.h"
 #include <typeinfo>
 #include <sys/stat.h>			/* mknod(2) */
@@ -60,6 +64,7 @@ DebuggerMainWnd::DebuggerMainWnd() :
 #ifdef GDB_TRANSCRIPT
 	m_transcriptFile(GDB_TRANSCRIPT),
 #endif
+	m_pipelineDepth(4),
 	m_outputTermCmdStr(QLatin1String(defaultTermCmdStr)),
 	m_outputTermProc(new QProcess),
 	m_ttyLevel(-1),			/* no tty yet */
@@ -99,6 +104,12 @@ DebuggerMainWnd::DebuggerMainWnd() :
     QDockWidget* dw8 = createDockWidget("Memory", i18n("Memory"));
     m_memoryWindow = new MemoryWindow(dw8);
     dw8->setWidget(m_memoryWindow);
+    QDockWidget* dw9 = createDockWidget("Statistics", i18n("Statistics"));
+    m_statistics = new StatisticsWindow(dw9);
+    dw9->setWidget(m_statistics);
+    QDockWidget* dw10 = createDockWidget("Disassembly", i18n("Disassembly"));
+    m_disassembly = new DisassemblyWindow(dw10);
+    dw10->setWidget(m_disassembly);
 
     m_debugger = new KDebugger(this, m_localVariables, m_watches->watchVariables(), m_btWindow);
 
@@ -108,6 +119,8 @@ DebuggerMainWnd::DebuggerMainWnd() :
     connect(m_debugger, SIGNAL(debuggerStarting()), SLOT(slotDebuggerStarting()));
     m_bpTable->setDebugger(m_debugger);
     m_memoryWindow->setDebugger(m_debugger);
+    m_statistics->setDebugger(m_debugger);
+    m_disassembly->setDebugger(m_debugger);
 
     setStandardToolBarMenuEnabled(true);
     initKAction();
@@ -141,6 +154,20 @@ DebuggerMainWnd::DebuggerMainWnd() :
     connect(m_debugger, SIGNAL(disassembled(const QString&,int,const std::list<DisassembledCode>&)),
 	    m_filesWindow, SLOT(slotDisassembled(const QString&,int,const std::list<DisassembledCode>&)));
     connect(m_debugger, &KDebugger::disassFlavorChanged, m_filesWindow, &WinStack::slotFlavorChanged);
+
+    // disassembly window
+    connect(m_debugger, SIGNAL(updatePC(const QString&,int,const DbgAddr&,int)),
+	    m_disassembly, SLOT(updatePC(const QString&,int,const DbgAddr&,int)));
+    connect(m_debugger, SIGNAL(activateFileLine(const QString&,int,const DbgAddr&)),
+	    m_disassembly, SLOT(slotActivateFileLine(const QString&,int,const DbgAddr&)));
+    connect(m_disassembly, SIGNAL(disassemble(const DbgAddr&)),
+	    m_debugger, SLOT(slotDisassembleFunction(const DbgAddr&)));
+    connect(m_debugger, SIGNAL(disassembledFunction(const DbgAddr&,const std::list<DisassembledCode>&)),
+	    m_disassembly, SLOT(slotDisassembled(const DbgAddr&,const std::list<DisassembledCode>&)));
+    connect(m_debugger, SIGNAL(breakpointsChanged()), m_disassembly, SLOT(updateBreakpoints()));
+    connect(m_debugger, SIGNAL(executableUpdated()), m_disassembly, SLOT(clearCache()));
+    connect(m_debugger, SIGNAL(debuggerStarting()), m_disassembly, SLOT(clearCache()));
+    connect(m_debugger, &KDebugger::disassFlavorChanged, m_disassembly, &DisassemblyWindow::clearCache);
     connect(m_filesWindow, SIGNAL(moveProgramCounter(const QString&,int,const DbgAddr&)),
 	    m_debugger, SLOT(setProgramCounter(const QString&,int,const DbgAddr&)));
     // program stopped
@@ -196,6 +223,8 @@ DebuggerMainWnd::~DebuggerMainWnd()
     delete m_debugger;
     m_debugger = nullptr;
 
+    delete m_disassembly;
+    delete m_statistics;
     delete m_memoryWindow;
     delete m_threads;
     delete m_ttyWindow;
@@ -285,7 +314,9 @@ void DebuggerMainWnd::initKAction()
 	{ m_bpTable, "view_breakpoints", &m_bpTableAction },
 	{ m_threads, "view_threads", &m_threadsAction },
 	{ m_ttyWindow, "view_output", &m_ttyWindowAction },
-	{ m_memoryWindow, "view_memory", &m_memoryWindowAction }
+	{ m_memoryWindow, "view_memory", &m_memoryWindowAction },
+	{ m_statistics, "view_statistics", &m_statisticsAction },
+	{ m_disassembly, "view_disassembly", &m_disassemblyAction }
     };
     for (unsigned i = 0; i < sizeof(dw)/sizeof(dw[0]); i++) {
 	QDockWidget* d = dockParent(dw[i].w);
@@ -441,6 +472,7 @@ static const char TermCmdStr[] = "TermCmdStr";
 static const char KeepScript[] = "KeepScript";
 static const char DebuggerGroup[] = "Debugger";
 static const char DebuggerCmdStr[] = "DebuggerCmdStr";
+static const char PipelineDepth[] = "PipelineDepth";
 static const char PreferencesGroup[] = "Preferences";
 static const char PopForeground[] = "PopForeground";
 static const char BackTimeout[] = "BackTimeout";
@@ -462,7 +494,9 @@ void DebuggerMainWnd::saveSettings(KSharedConfigPtr config)
     }
 
     config->group(QLatin1String(OutputWindowGroup)).writeEntry(TermCmdStr, m_outputTermCmdStr);
-    config->group(QLatin1String(DebuggerGroup)).writeEntry(DebuggerCmdStr, m_debuggerCmdStr);
+    KConfigGroup dg(config->group(QLatin1String(DebuggerGroup)));
+    dg.writeEntry(DebuggerCmdStr, m_debuggerCmdStr);
+    dg.writeEntry(PipelineDepth, m_pipelineDepth);
 
     KConfigGroup pg(config->group(QLatin1String(PreferencesGroup)));
     pg.writeEntry(PopForeground, m_popForeground);
@@ -499,7 +533,9 @@ void DebuggerMainWnd::restoreSettings(KSharedConfigPtr config)
     setTerminalCmd(og.readEntry(TermCmdStr, defaultTermCmdStr));
     m_outputTermKeepScript = og.readEntry(KeepScript);
 
-    setDebuggerCmdStr(config->group(QLatin1String(DebuggerGroup)).readEntry(DebuggerCmdStr));
+    KConfigGroup dg(config->group(QLatin1String(DebuggerGroup)));
+    setDebuggerCmdStr(dg.readEntry(DebuggerCmdStr));
+    m_pipelineDepth = qMax(1, dg.readEntry(PipelineDepth, 4));
 
     KConfigGroup pg(config->group(QLatin1String(PreferencesGroup)));
     m_popForeground = pg.readEntry(PopForeground, false);
@@ -630,6 +666,9 @@ void DebuggerMainWnd::makeDefaultLayout()
     tabifyDockWidget(dockParent(m_bpTable), dockParent(m_ttyWindow));
     tabifyDockWidget(dockParent(m_ttyWindow), dockParent(m_btWindow));
     tabifyDockWidget(dockParent(m_threads), dockParent(m_watches));
+    tabifyDockWidget(dockParent(m_btWindow), dockParent(m_statistics));
+    tabifyDockWidget(dockParent(m_memoryWindow), dockParent(m_disassembly));
+    dockParent(m_statistics)->setVisible(false);
     dockParent(m_localVariables)->setVisible(true);
     dockParent(m_ttyWindow)->setVisible(true);
     dockParent(m_watches)->setVisible(true);
@@ -679,8 +718,14 @@ bool DebuggerMainWnd::startDriver(const QString& executable, QString lang)
 {
     assert(m_debugger);
 
-    TRACE(QString("trying language '%1'...").arg(lang));
-    DebuggerDriver* driver = driverFromLang(lang);
+    DebuggerDriver* driver = nullptr;
+    if (!m_replayFile.isEmpty()) {
+	TRACE("replaying " + m_replayFile);
+	driver = new ReplayDriver(m_replayFile);
+    } else {
+	TRACE(QString("trying language '%1'...").arg(lang));
+	driver = driverFromLang(lang);
+    }
 
     if (!driver)
     {
@@ -719,6 +764,8 @@ bool DebuggerMainWnd::startDriver(const QString& executable, QString lang)
     }
 
     driver->setLogFileName(m_transcriptFile);
+    driver->setRecordFileName(m_recordFile);
+    driver->setPipelineDepth(m_pipelineDepth);
 
     bool success = m_debugger->debugProgram(executable, driver);
 
@@ -751,6 +798,7 @@ DebuggerDriver* DebuggerMainWnd::driverFromLang(QString lang)
 	{ "p",       "python",  3 },
 	// the following are actually driver names
 	{ "gdb",     "gdb",     1 },
+	{ "gdbm",    "gdbmi",   2 },
     };
     const int N = sizeof(langs)/sizeof(langs[0]);
 
@@ -780,6 +828,13 @@ DebuggerDriver* DebuggerMainWnd::driverFromLang(QString lang)
 	    driver = gdb;
 	}
 	break;
+    case 2:
+	{
+	    GdbMiDriver* gdb = new GdbMiDriver;
+	    gdb->setDefaultInvocation(m_debuggerCmdStr);
+	    driver = gdb;
+	}
+	break;
     default:
 	// unknown language
 	break;
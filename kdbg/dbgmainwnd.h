@@ -30,6 +30,8 @@ class ExprWnd;
 class BreakpointTable;
 class ThreadList;
 class MemoryWindow;
+class StatisticsWindow;
+class DisassemblyWindow;
 class TTYWindow;
 class WatchWindow;
 class KDebugger;
@@ -49,6 +51,15 @@ public:
      * Specifies the file where to write the transcript.
      */
     void setTranscript(const QString& name);
+    /**
+     * Specifies the file where to record the session for a later replay.
+     */
+    void setRecordFile(const QString& name) { m_recordFile = name; }
+    /**
+     * Specifies a recorded session that is replayed instead of running
+     * the debugger.
+     */
+    void setReplayFile(const QString& name) { m_replayFile = name; }
     /**
      * Specifies the process to attach to after the program is loaded.
      */
@@ -81,6 +92,8 @@ protected:
     TTYWindow* m_ttyWindow;
     ThreadList* m_threads;
     MemoryWindow* m_memoryWindow;
+    StatisticsWindow* m_statistics;
+    DisassemblyWindow* m_disassembly;
 
     QTimer m_backTimer;
 
@@ -100,6 +113,8 @@ protected:
     QAction* m_ttyWindowAction;
     QAction* m_threadsAction;
     QAction* m_memoryWindowAction;
+    QAction* m_statisticsAction;
+    QAction* m_disassemblyAction;
     QAction* m_runAction;
     QAction* m_stepIntoAction;
     QAction* m_stepOverAction;
@@ -133,6 +148,9 @@ protected:
     QString m_debuggerCmdStr;
     KDebugger* m_debugger = {};
     QString m_transcriptFile;		/* where gdb dialog is logged */
+    QString m_recordFile;		/* where the session is recorded */
+    QString m_replayFile;		/* the session to replay */
+    int m_pipelineDepth;		/* commands sent to gdb in one go */
 
     /**
      * Starts to debug the specified program using the specified language
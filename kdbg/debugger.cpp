@@ -11,6 +11,7 @@
 #include "exprwnd.h"
 #include "pgmsettings.h"
 #include <QFileInfo>
+#include <QHash>
 #include <QListWidget>
 #include <QApplication>
 #include <QCryptographicHash>
@@ -190,6 +191,7 @@ bool KDebugger::debugProgram(const QString& name,
 
     // create a type table
     m_typeTable = new ProgramTypeTable;
+    m_structBatchCmds.clear();
     m_sharedLibsListed = false;
 
     Q_EMIT updateUI();
@@ -695,6 +697,9 @@ void KDebugger::gdbExited()
     // erase types
     delete m_typeTable;
     m_typeTable = nullptr;
+    m_structBatchCmds.clear();
+    m_localVariables.clearNames();
+    m_watchVariables.clearNames();
 
     if (m_explicitKill) {
 	TRACE(m_d->driverName() + " exited normally");
@@ -760,6 +765,12 @@ const char WorkingDirectory[] = "WorkingDirectory";
 const char Variable[] = "Var%d";
 const char Value[] = "Value%d";
 const char ExprFmt[] = "Expr%d";
+const char ExpandedLocalsGroup[] = "ExpandedLocals";
+const char FunctionFmt[] = "Function%d";
+const char PathsFmt[] = "Paths%d";
+
+// the number of functions whose expanded local variables are remembered
+static const size_t maxExpandedFunctions = 100;
 
 void KDebugger::saveProgramSettings()
 {
@@ -804,6 +815,29 @@ void KDebugger::saveProgramSettings()
 	wg.writeEntry(varName, expr);
     }
 
+    // expanded local variables
+    saveLocalsExpansion();
+    m_programConfig->deleteGroup(QLatin1String(ExpandedLocalsGroup));
+    KConfigGroup xg = m_programConfig->group(QLatin1String(ExpandedLocalsGroup));
+    // most recently used first, so that the order survives a restart
+    typedef std::pair<const QString,ExpandedLocals> FuncEntry;
+    std::vector<const FuncEntry*> funcs;
+    for (const auto& f : m_expandedLocals) {
+	if (!f.second.paths.isEmpty())
+	    funcs.push_back(&f);
+    }
+    std::sort(funcs.begin(), funcs.end(), [](const FuncEntry* a, const FuncEntry* b) {
+	return a->second.lastUse > b->second.lastUse;
+    });
+    if (funcs.size() > maxExpandedFunctions)
+	funcs.resize(maxExpandedFunctions);
+    int funcNum = 0;
+    for (const FuncEntry* f : funcs) {
+	xg.writeEntry(QString::asprintf(FunctionFmt, funcNum), f->first);
+	xg.writeEntry(QString::asprintf(PathsFmt, funcNum), QStringList(f->second.paths.values()));
+	funcNum++;
+    }
+
     // give others a chance
     Q_EMIT saveProgramSpecific(m_programConfig);
 }
@@ -875,6 +909,24 @@ void KDebugger::restoreProgramSettings()
 	addWatch(expr);
     }
 
+    // expanded local variables
+    KConfigGroup xg = m_programConfig->group(QLatin1String(ExpandedLocalsGroup));
+    m_expandedLocals.clear();
+    int numFuncs = 0;
+    while (size_t(numFuncs) < maxExpandedFunctions &&
+	   xg.hasKey(QString::asprintf(FunctionFmt, numFuncs)))
+    {
+	numFuncs++;
+    }
+    m_expansionClock = numFuncs;
+    for (int i = 0; i < numFuncs; ++i) {
+	varName = QString::asprintf(FunctionFmt, i);
+	QStringList paths = xg.readEntry(QString::asprintf(PathsFmt, i), QStringList());
+	ExpandedLocals& e = m_expandedLocals[xg.readEntry(varName, QString())];
+	e.paths = QSet<QString>(paths.begin(), paths.end());
+	e.lastUse = numFuncs - i;	/* the first is the most recent */
+    }
+
     // give others a chance
     Q_EMIT restoreProgramSpecific(m_programConfig);
 }
@@ -1089,6 +1141,9 @@ void KDebugger::parse(CmdQueueItem* cmd, const char* output)
     case DCdisassemble:
 	handleDisassemble(cmd, output);
 	break;
+    case DCdisassembleFunc:
+	handleDisassembleFunction(cmd, output);
+	break;
     case DCsetdisassflavor:
 	handleSetDisassFlavor(output);
 	break;
@@ -1109,6 +1164,9 @@ void KDebugger::parse(CmdQueueItem* cmd, const char* output)
     case DCprintDeref:
 	handlePrintDeref(cmd, output);
 	break;
+    case DCprintSlice:
+	handlePrintSlice(cmd, output);
+	break;
     case DCattach:
 	m_haveExecutable = true;
 	// fall through
@@ -1156,6 +1214,11 @@ void KDebugger::parse(CmdQueueItem* cmd, const char* output)
     case DCprintWChar:
 	handlePrintStruct(cmd, output);
 	break;
+    case DCprintStructBatch:
+	handlePrintStructBatch(cmd, output);
+	break;
+    case DCdefineStruct:
+	break;
     case DCinfosharedlib:
 	handleSharedLibs(output);
 	break;
@@ -1177,6 +1240,10 @@ void KDebugger::parse(CmdQueueItem* cmd, const char* output)
 
 void KDebugger::backgroundUpdate()
 {
+    // the debugger is idle: show what has arrived so far
+    m_localVariables.flushRepaint();
+    m_watchVariables.flushRepaint();
+
     /*
      * If there are still expressions that need to be updated, then do so.
      */
@@ -1262,6 +1329,8 @@ void KDebugger::updateAllExprs()
     if (!m_programActive)
 	return;
 
+    resetExprBudgets();
+
     // retrieve local variables
     m_d->queueCmd(DCinfolocals);
 
@@ -1273,7 +1342,12 @@ void KDebugger::updateAllExprs()
 	queueMemoryDump(false, true);
     }
 
-    // update watch expressions
+    /*
+     * Update watch expressions. The values that are still pending from
+     * the previous stop will be requested again.
+     */
+    m_watchEvalExpr.clear();
+    m_watchVariables.clearPendingValueUpdates();
     for (const QString& expr : m_watchVariables.exprList()) {
 	m_watchEvalExpr.push_back(expr);
     }
@@ -1320,14 +1394,8 @@ void KDebugger::updateProgEnvironment(const QString& args, const QString& wd,
 
 void KDebugger::handleLocals(const char* output)
 {
-    // retrieve old list of local variables
-    QStringList oldVars = m_localVariables.exprList();
-
-    /*
-     *  Get local variables.
-     */
-    std::list<ExprValue*> newVars;
-    parseLocals(output, newVars);
+    // remember what the user expanded before the items change
+    saveLocalsExpansion();
 
     /*
      * Clear any old VarTree item pointers, so that later we don't access
@@ -1335,72 +1403,218 @@ void KDebugger::handleLocals(const char* output)
      */
     m_localVariables.clearPendingUpdates();
 
+    // index the old variables by name
+    QHash<QString, VarTree*> oldVars;
+    oldVars.reserve(m_localVariables.topLevelItemCount());
+    for (int i = 0; i < m_localVariables.topLevelItemCount(); i++) {
+	VarTree* v = m_localVariables.topLevelItem(i);
+	if (!oldVars.contains(v->getText()))
+	    oldVars.insert(v->getText(), v);
+    }
+
+    // only variables that are still displayed can remain unchanged
+    for (auto i = m_localsPrinted.begin(); i != m_localsPrinted.end(); ) {
+	if (oldVars.contains(i.key()))
+	    ++i;
+	else
+	    i = m_localsPrinted.erase(i);
+    }
+
     /*
-     * Match old variables against new ones.
+     *  Get local variables.
+     */
+    std::list<ExprValue*> newVars;
+    parseLocals(output, newVars);
+
+    /*
+     * Match new variables against old ones.
      */
-    for (auto n = oldVars.begin(); n != oldVars.end(); ++n)
+    for (ExprValue* v : newVars)
     {
-	// lookup this variable in the list of new variables
-	std::list<ExprValue*>::iterator v = newVars.begin();
-	while (v != newVars.end() && (*v)->m_name != *n)
-	    ++v;
-	if (v == newVars.end()) {
-	    // old variable not in the new variables
-	    TRACE("old var deleted: " + *n);
-	    VarTree* v = m_localVariables.topLevelExprByName(*n);
-	    if (v) {
-		m_localVariables.removeExpr(v);
+	auto o = oldVars.find(v->m_name);
+	if (o != oldVars.end()) {
+	    // variable in both old and new lists: update
+	    if (v->m_unchanged) {
+		m_localVariables.keepExpr(*o);
+	    } else {
+		TRACE("update var: " + v->m_name);
+		m_localVariables.updateExpr(*o, v, *m_typeTable);
 	    }
+	    oldVars.erase(o);
 	} else {
-	    // variable in both old and new lists: update
-	    TRACE("update var: " + *n);
-	    m_localVariables.updateExpr(*v, *m_typeTable);
-	    // remove the new variable from the list
-	    delete *v;
-	    newVars.erase(v);
+	    ASSERT(!v->m_unchanged);
+	    TRACE("new var: " + v->m_name);
+	    m_localVariables.insertExpr(v, *m_typeTable);
 	}
+	delete v;
     }
-    // insert all remaining new variables
-    while (!newVars.empty())
+    // remove the old variables that are not in the new variables
+    for (VarTree* v : oldVars)
     {
-	ExprValue* v = newVars.front();
-	TRACE("new var: " + v->m_name);
-	m_localVariables.insertExpr(v, *m_typeTable);
-	delete v;
-	newVars.pop_front();
+	TRACE("old var deleted: " + v->getText());
+	m_localVariables.removeExpr(v);
+    }
+
+    /*
+     * Expand the items that were expanded the last time we were in this
+     * function. This dereferences the pointers right away.
+     */
+    bool functionChanged = m_localsFunction != m_frameFunction;
+    m_localsFunction = m_frameFunction;
+    for (int i = 0; i < m_localVariables.topLevelItemCount(); i++)
+	restoreLocalsExpansion(m_localVariables.topLevelItem(i), functionChanged);
+
+    /*
+     * The symbols that a watch expression can use depend on the function
+     * and on the blocks of it that are active; the latter is reflected by
+     * the set of local variables. The scope must not depend on the
+     * location in the function or on the values of the arguments, so that
+     * a watch that failed at one line is skipped at the next line.
+     */
+    QString scope;
+    if (!m_localsFunction.isEmpty()) {
+	QStringList names;
+	for (int i = 0; i < m_localVariables.topLevelItemCount(); i++)
+	    names.append(m_localVariables.topLevelItem(i)->getText());
+	names.sort();
+	scope = m_localsFunction + QLatin1Char('\n') + names.join(QLatin1Char('\n'));
+    }
+    if (scope != m_localsScope) {
+	m_localsScope = scope;
+	m_missingSymbols.clear();
+    }
+}
+
+/*
+ * An item is identified by the names of the items on the path from the
+ * top-level item. The address of a dereferenced pointer is not part of
+ * the path because it changes.
+ */
+static QString expansionPathComponent(const VarTree* item)
+{
+    return item->m_nameKind == VarTree::NKaddress ?
+		QStringLiteral("*") : item->getText();
+}
+
+static QString expansionPath(const VarTree* item)
+{
+    QString path = expansionPathComponent(item);
+    while ((item = static_cast<const VarTree*>(item->parent())))
+	path = expansionPathComponent(item) + QLatin1Char('/') + path;
+    return path;
+}
+
+static bool canExpand(const VarTree* item)
+{
+    // continuation items would fetch data that the user did not ask for
+    return item->m_nameKind != VarTree::NKmore &&
+	(item->childCount() > 0 ||
+	 item->childIndicatorPolicy() == QTreeWidgetItem::ShowIndicator);
+}
+
+static void saveExpansion(const VarTree* item, const QString& path, QSet<QString>& expanded)
+{
+    if (!canExpand(item))
+	return;
+    if (item->isExpanded())
+	expanded.insert(path);
+    else
+	expanded.remove(path);
+    for (int i = 0; i < item->childCount(); i++) {
+	const VarTree* c = item->child(i);
+	saveExpansion(c, path + QLatin1Char('/') + expansionPathComponent(c), expanded);
+    }
+}
+
+static void restoreExpansion(VarTree* item, const QString& path,
+			     const QSet<QString>& expanded, bool exact)
+{
+    if (!canExpand(item))
+	return;
+    bool want = expanded.contains(path);
+    if (want && !item->isExpanded())
+	item->setExpanded(true);	/* dereferences pointers */
+    else if (exact && !want && item->isExpanded())
+	item->setExpanded(false);
+    if (!item->isExpanded())
+	return;
+    for (int i = 0; i < item->childCount(); i++) {
+	VarTree* c = item->child(i);
+	restoreExpansion(c, path + QLatin1Char('/') + expansionPathComponent(c), expanded, exact);
+    }
+}
+
+/*
+ * Records which items of the locals window are expanded. Paths of items
+ * that do not exist at the moment are kept, so that, e.g., a pointer that
+ * is temporarily NULL is expanded again later.
+ */
+void KDebugger::saveLocalsExpansion()
+{
+    if (m_localsFunction.isEmpty())
+	return;
+    QSet<QString>& expanded = useExpandedLocals(m_localsFunction).paths;
+    for (int i = 0; i < m_localVariables.topLevelItemCount(); i++) {
+	VarTree* item = m_localVariables.topLevelItem(i);
+	saveExpansion(item, expansionPath(item), expanded);
+    }
+}
+
+/*
+ * Expands the items in the sub-tree that were expanded previously in the
+ * current function. If exact is true, other items are collapsed.
+ */
+void KDebugger::restoreLocalsExpansion(VarTree* item, bool exact)
+{
+    auto e = m_expandedLocals.find(m_localsFunction);
+    if (e == m_expandedLocals.end())
+	return;
+    e->second.lastUse = ++m_expansionClock;
+    restoreExpansion(item, expansionPath(item), e->second.paths, exact);
+}
+
+/*
+ * Returns the expanded items of the function and marks them as used most
+ * recently. The least recently used function is forgotten if there are
+ * too many.
+ */
+KDebugger::ExpandedLocals& KDebugger::useExpandedLocals(const QString& func)
+{
+    if (m_expandedLocals.size() >= maxExpandedFunctions &&
+	m_expandedLocals.find(func) == m_expandedLocals.end())
+    {
+	auto oldest = std::min_element(m_expandedLocals.begin(), m_expandedLocals.end(),
+		[](const std::pair<const QString,ExpandedLocals>& a,
+		   const std::pair<const QString,ExpandedLocals>& b) {
+		    return a.second.lastUse < b.second.lastUse;
+		});
+	m_expandedLocals.erase(oldest);
     }
+    ExpandedLocals& e = m_expandedLocals[func];
+    e.lastUse = ++m_expansionClock;
+    return e;
 }
 
 void KDebugger::parseLocals(const char* output, std::list<ExprValue*>& newVars)
 {
-    std::list<ExprValue*> vars;
-    m_d->parseLocals(output, vars);
+    m_d->parseLocals(output, newVars, m_localsPrinted);
 
-    QString origName;			/* used in renaming variables */
-    while (!vars.empty())
+    /*
+     * When gdb prints local variables, those from the innermost block
+     * come first. We count how often we have seen each name (ie. how
+     * many variables hide the current one from a surrounding block). We
+     * keep the name of the inner variable, but rename those from the
+     * outer block so that, when the value is updated in the window, the
+     * value of the variable that is _visible_ changes the color!
+     */
+    QHash<QString, int> blocks;
+    for (ExprValue* variable : newVars)
     {
-	ExprValue* variable = vars.front();
-	vars.pop_front();
-	/*
-	 * When gdb prints local variables, those from the innermost block
-	 * come first. We run through the list of already parsed variables
-	 * to find duplicates (ie. variables that hide local variables from
-	 * a surrounding block). We keep the name of the inner variable, but
-	 * rename those from the outer block so that, when the value is
-	 * updated in the window, the value of the variable that is
-	 * _visible_ changes the color!
-	 */
-	int block = 0;
-	origName = variable->m_name;
-	for (std::list<ExprValue*>::iterator v = newVars.begin(); v != newVars.end(); ++v) {
-	    if (variable->m_name == (*v)->m_name) {
-		// we found a duplicate, change name
-		block++;
-		QString newName = QLatin1String("%1 (%2)").arg(origName, QString().setNum(block));
-		variable->m_name = newName;
-	    }
+	int block = blocks[variable->m_name]++;
+	if (block > 0) {
+	    // we found a duplicate, change name
+	    variable->m_name = QLatin1String("%1 (%2)").arg(variable->m_name, QString::number(block));
 	}
-	newVars.push_back(variable);
     }
 }
 
@@ -1421,6 +1635,20 @@ bool KDebugger::handlePrint(CmdQueueItem* cmd, const char* output)
 	delete variable;
     }
 
+    // remember whether a watch expression can be evaluated in this scope
+    if (cmd->m_exprWnd == &m_watchVariables && cmd->m_expr->isToplevelExpr())
+    {
+	QString symbol = m_d->parseMissingSymbol(output);
+	WatchScope& ws = m_watchScopes[cmd->m_expr->getText()];
+	if (!symbol.isEmpty() && !m_localsScope.isEmpty()) {
+	    m_missingSymbols.insert(symbol);
+	    ws.failedScope = m_localsScope;
+	} else {
+	    ws.failedScope.clear();
+	}
+	cmd->m_expr->setOutOfScope(!symbol.isEmpty());
+    }
+
     evalExpressions();			/* enqueue dereferenced pointers */
 
     return true;
@@ -1471,12 +1699,54 @@ bool KDebugger::handlePrintDeref(CmdQueueItem* cmd, const char* output)
 	cmd->m_exprWnd->updateExpr(cmd->m_expr, dummyParent, *m_typeTable);
 	delete dummyParent;
     }
+    if (cmd->m_exprWnd == &m_localVariables)
+	restoreLocalsExpansion(cmd->m_expr, false);
 
     evalExpressions();			/* enqueue dereferenced pointers */
 
     return true;
 }
 
+// the number of array elements that are requested when "..." is expanded
+static const int arraySliceLength = 200;
+
+/*
+ * The index of the first element that the continuation item stands for.
+ */
+static int continuationIndex(VarTree* more)
+{
+    VarTree* array = static_cast<VarTree*>(more->parent());
+    int i = array->indexOfChild(more);
+    return i > 0 ? array->child(i-1)->nextArrayIndex() : 0;
+}
+
+void KDebugger::fetchArraySlice(ExprWnd* wnd, VarTree* more)
+{
+    VarTree* array = static_cast<VarTree*>(more->parent());
+    QString expr = array->computeExpr();
+    TRACE("fetching array elements: " + expr);
+    CmdQueueItem* cmd = m_d->queueCmdPrio(DCprintSlice, expr,
+					  continuationIndex(more), arraySliceLength);
+    cmd->m_expr = more;
+    cmd->m_exprWnd = wnd;
+}
+
+void KDebugger::handlePrintSlice(CmdQueueItem* cmd, const char* output)
+{
+    ASSERT(cmd->m_expr);
+
+    ExprValue* slice = m_d->parsePrintExpr(output, true);
+    if (!slice)
+	return;
+
+    int start = continuationIndex(cmd->m_expr);
+    cmd->m_exprWnd->insertArraySlice(cmd->m_expr, slice, start,
+				     arraySliceLength, *m_typeTable);
+    delete slice;
+
+    evalExpressions();			/* types and values of the elements */
+}
+
 // parse the output of bt
 void KDebugger::handleBacktrace(const char* output)
 {
@@ -1491,17 +1761,21 @@ void KDebugger::handleBacktrace(const char* output)
 	// note: frm->lineNo is zero-based
 	Q_EMIT updatePC(frm->fileName, frm->lineNo, frm->address, frm->frameNo);
 
+	m_stackFunctions.clear();
 	for (; frm != stack.end(); ++frm) {
 	    QString func;
 	    if (frm->var)
 		func = frm->var->m_name;
 	    else
 		func = frm->fileName + QLatin1Char(':') + QString().setNum(frm->lineNo+1);
+	    // the arguments and the location change from stop to stop
+	    m_stackFunctions.append(frm->function.isEmpty() ? func : frm->function);
         
  	    m_btWindow.addItem(func);
 	    TRACE("frame " + func + " (" + frm->fileName + ":" +
 		  QString().setNum(frm->lineNo+1) + ")");
 	}
+	m_frameFunction = m_stackFunctions.first();	/* the locals are those of frame 0 */
     }
 
 }
@@ -1522,6 +1796,9 @@ void KDebugger::handleFrameChange(const char* output)
     int lineNo;
     DbgAddr address;
     if (m_d->parseFrameChange(output, frameNo, fileName, lineNo, address)) {
+	// the locals that follow are those of this frame
+	if (frameNo >= 0 && frameNo < m_stackFunctions.size())
+	    m_frameFunction = m_stackFunctions[frameNo];
 	/* lineNo can be negative here if we can't find a file name */
 	Q_EMIT updatePC(fileName, lineNo, address, frameNo);
     } else {
@@ -1529,22 +1806,118 @@ void KDebugger::handleFrameChange(const char* output)
     }
 }
 
+/*
+ * The number of updates that an expression window may request after a
+ * stop before the other window gets its turn.
+ */
+static const int visibleExprBudget = 64;
+static const int hiddenExprBudget = 8;
+
+static int exprWndRank(const ExprWnd& wnd)
+{
+    return (wnd.hasFocus() ? 2 : 0) + (wnd.isVisible() ? 1 : 0);
+}
+
+void KDebugger::resetExprBudgets()
+{
+    m_localsBudget = m_localVariables.isVisible() ? visibleExprBudget : hiddenExprBudget;
+    m_watchBudget = m_watchVariables.isVisible() ? visibleExprBudget : hiddenExprBudget;
+}
+
+/*
+ * The names that an expression refers to, except those that are members
+ * or are qualified by a scope. These are the names that the debugger can
+ * report as unknown in the current context.
+ */
+static QStringList exprSymbols(const QString& expr)
+{
+    QStringList symbols;
+    const QChar* p = expr.constData();
+    const QChar* end = p + expr.size();
+    bool member = false;		/* after ., ->, or :: */
+    while (p < end)
+    {
+	if (p->isLetter() || *p == QLatin1Char('_') || *p == QLatin1Char('$')) {
+	    const QChar* start = p;
+	    while (p < end && (p->isLetterOrNumber() || *p == QLatin1Char('_') ||
+			       *p == QLatin1Char('$')))
+		p++;
+	    if (!member)
+		symbols.append(QString(start, p-start));
+	    member = false;
+	} else if (p->isDigit()) {
+	    // a number, including suffixes and hex digits
+	    while (p < end && (p->isLetterOrNumber() || *p == QLatin1Char('.')))
+		p++;
+	    member = false;
+	} else if (*p == QLatin1Char('"') || *p == QLatin1Char('\'')) {
+	    QChar quote = *p++;
+	    while (p < end && *p != quote) {
+		if (*p == QLatin1Char('\\') && p+1 < end)
+		    p++;
+		p++;
+	    }
+	    if (p < end)
+		p++;
+	    member = false;
+	} else if (p->isSpace()) {
+	    p++;
+	} else {
+	    member = *p == QLatin1Char('.') ||
+		(*p == QLatin1Char('>') && p > expr.constData() && p[-1] == QLatin1Char('-')) ||
+		(*p == QLatin1Char(':') && p > expr.constData() && p[-1] == QLatin1Char(':'));
+	    p++;
+	}
+    }
+    symbols.removeDuplicates();
+    return symbols;
+}
+
+/*
+ * A watch expression is not evaluated if it failed in the same scope
+ * before, or if it uses a symbol that another expression found missing.
+ */
+bool KDebugger::isWatchOutOfScope(const QString& expr)
+{
+    if (m_localsScope.isEmpty())
+	return false;			/* we don't know the scope */
+    WatchScope& ws = m_watchScopes[expr];
+    if (ws.failedScope == m_localsScope)
+	return true;
+    if (!ws.haveSymbols) {
+	ws.symbols = exprSymbols(expr);
+	ws.haveSymbols = true;
+    }
+    for (const QString& symbol : ws.symbols) {
+	if (m_missingSymbols.contains(symbol)) {
+	    ws.failedScope = m_localsScope;
+	    return true;
+	}
+    }
+    return false;
+}
+
 void KDebugger::evalExpressions()
 {
     // evaluate expressions in the following order:
     //   watch expressions
-    //   pointers in local variables
-    //   pointers in watch expressions
-    //   types in local variables
-    //   types in watch expressions
-    //   struct members in local variables
-    //   struct members in watch expressions
+    //   pending updates of the window with the focus, or the visible one,
+    //     as long as its budget lasts
+    //   pending updates of the other window within its budget
+    //   the remaining updates in the same order
+    // See evalNextUpdate() for the order within a window.
     VarTree* exprItem = nullptr;
-    if (!m_watchEvalExpr.empty())
+    while (!exprItem && !m_watchEvalExpr.empty())
     {
 	QString expr = m_watchEvalExpr.front();
 	m_watchEvalExpr.pop_front();
 	exprItem = m_watchVariables.topLevelExprByName(expr);
+	// keep the last value, but grey it out
+	if (exprItem && isWatchOutOfScope(expr)) {
+	    TRACE("out of scope: " + expr);
+	    exprItem->setOutOfScope(true);
+	    exprItem = nullptr;
+	}
     }
     if (exprItem) {
 	CmdQueueItem* cmd = m_d->queueCmd(DCprint, exprItem->getText());
@@ -1552,53 +1925,56 @@ void KDebugger::evalExpressions()
 	cmd->m_expr = exprItem;
 	cmd->m_exprWnd = &m_watchVariables;
     } else {
-	ExprWnd* wnd;
-#define POINTER(widget) \
-		wnd = &widget; \
-		exprItem = widget.nextUpdatePtr(); \
-		if (exprItem) goto pointer
-#define STRUCT(widget) \
-		wnd = &widget; \
-		exprItem = widget.nextUpdateStruct(); \
-		if (exprItem) goto ustruct
-#define TYPE(widget) \
-		wnd = &widget; \
-		exprItem = widget.nextUpdateType(); \
-		if (exprItem) goto type
-    repeat:
-	POINTER(m_localVariables);
-	POINTER(m_watchVariables);
-	STRUCT(m_localVariables);
-	STRUCT(m_watchVariables);
-	TYPE(m_localVariables);
-	TYPE(m_watchVariables);
-#undef POINTER
-#undef STRUCT
-#undef TYPE
-	return;
+	ExprWnd* wnds[] = { &m_localVariables, &m_watchVariables };
+	int* budgets[] = { &m_localsBudget, &m_watchBudget };
+	if (exprWndRank(m_watchVariables) > exprWndRank(m_localVariables)) {
+	    std::swap(wnds[0], wnds[1]);
+	    std::swap(budgets[0], budgets[1]);
+	}
+	for (int pass = 0; pass < 2; pass++) {
+	    for (int i = 0; i < 2; i++) {
+		if (pass == 0 && *budgets[i] <= 0)
+		    continue;
+		if (evalNextUpdate(wnds[i])) {
+		    --*budgets[i];
+		    return;
+		}
+	    }
+	}
+    }
+}
 
-	pointer:
+/*
+ * Queues the next update of the window: pointers first, then struct
+ * values, then types. Returns false if there is nothing to do.
+ */
+bool KDebugger::evalNextUpdate(ExprWnd* wnd)
+{
+    if (VarTree* exprItem = wnd->nextUpdatePtr()) {
 	// we have an expression to send
 	dereferencePointer(wnd, exprItem, false);
-	return;
-
-	ustruct:
+	return true;
+    }
+    while (VarTree* exprItem = wnd->nextUpdateStruct()) {
 	// paranoia
 	if (!exprItem->m_type || exprItem->m_type == TypeInfo::unknownType())
-	    goto repeat;
-	evalInitialStructExpression(exprItem, wnd, false);
-	return;
-
-	type:
+	    continue;
+	if (!evalInitialStructExpression(exprItem, wnd, false))
+	    continue;			/* known without the debugger */
+	return true;
+    }
+    while (VarTree* exprItem = wnd->nextUpdateType()) {
 	/*
 	 * Sometimes a VarTree gets registered twice for a type update. So
 	 * it may happen that it has already been updated. Hence, we ignore
 	 * it here and go on to the next task.
 	 */
 	if (exprItem->m_type)
-	    goto repeat;
+	    continue;
 	determineType(wnd, exprItem);
+	return true;
     }
+    return false;
 }
 
 void KDebugger::dereferencePointer(ExprWnd* wnd, VarTree* exprItem,
@@ -1664,14 +2040,71 @@ void KDebugger::handleFindType(CmdQueueItem* cmd, const char* output)
 	} else {
 	    cmd->m_expr->m_type = info;
 	    /* since this node has a new type, we get its value immediately */
-	    evalInitialStructExpression(cmd->m_expr, cmd->m_exprWnd, false);
-	    return;
+	    if (evalInitialStructExpression(cmd->m_expr, cmd->m_exprWnd, false))
+		return;
 	}
     }
 
     evalExpressions();			/* queue more of them */
 }
 
+/*
+ * Returns the member that expr selects from var if expr is of the form
+ * "(%s).a.b" and the member is a simple value that is displayed already.
+ */
+static VarTree* memberByPath(VarTree* var, const QString& expr)
+{
+    QString path;
+    if (expr.startsWith(QLatin1String("(%s).")))
+	path = expr.mid(5);
+    else if (expr.startsWith(QLatin1String("%s.")))
+	path = expr.mid(3);
+    else
+	return nullptr;
+
+    VarTree* v = var;
+    for (const QString& name : path.split(QLatin1Char('.'))) {
+	if (name.isEmpty() || name[0].isDigit())
+	    return nullptr;
+	for (QChar c : name) {
+	    if (!c.isLetterOrNumber() && c != QLatin1Char('_'))
+		return nullptr;
+	}
+	if (v->m_varKind != VarTree::VKstruct)
+	    return nullptr;
+	v = ExprWnd::memberByName(v, name);
+	if (!v)
+	    return nullptr;
+    }
+    if (v->m_varKind != VarTree::VKsimple || v->childCount() > 0)
+	return nullptr;
+    return v;
+}
+
+/*
+ * Expressions that only select members, such as "(%s).xp", are taken from
+ * the children of the struct that gdb has printed already. This advances
+ * var->m_exprIndex over such expressions and returns whether all
+ * expressions have been evaluated.
+ */
+static bool evalStructExprsFromMembers(VarTree* var)
+{
+    const TypeInfo* type = var->m_type;
+    while (var->m_exprIndex < type->m_numExprs)
+    {
+	int i = var->m_exprIndex;
+	if (!type->m_guardStrings[i].isEmpty())
+	    break;
+	VarTree* member = memberByPath(var, type->m_exprStrings[i]);
+	if (!member)
+	    break;
+	var->m_partialValue += member->value();
+	var->m_exprIndex++;
+	var->m_partialValue += type->m_displayString[var->m_exprIndex];
+    }
+    return var->m_exprIndex >= type->m_numExprs;
+}
+
 void KDebugger::handlePrintStruct(CmdQueueItem* cmd, const char* output)
 {
     VarTree* var = cmd->m_expr;
@@ -1732,6 +2165,8 @@ void KDebugger::handlePrintStruct(CmdQueueItem* cmd, const char* output)
 	// go for the real expression
 	var->m_exprIndexUseGuard = false;
     }
+    if (var->m_exprIndexUseGuard)
+	evalStructExprsFromMembers(var);
 
     /* go for more sub-expressions if needed */
     if (var->m_exprIndex < var->m_type->m_numExprs) {
@@ -1745,15 +2180,134 @@ void KDebugger::handlePrintStruct(CmdQueueItem* cmd, const char* output)
     evalExpressions();			/* enqueue dereferenced pointers */
 }
 
-/* queues the first printStruct command for a struct */
-void KDebugger::evalInitialStructExpression(VarTree* var, ExprWnd* wnd, bool immediate)
+void KDebugger::handlePrintStructBatch(CmdQueueItem* cmd, const char* output)
+{
+    VarTree* var = cmd->m_expr;
+    ASSERT(var);
+    ASSERT(var->m_varKind == VarTree::VKstruct);
+
+    std::list<ExprValue*> values;
+    m_d->parseStructBatch(output, values);
+
+    /*
+     * The values are appended to var->m_partialValue just like in
+     * handlePrintStruct(). The debugger stops at the first expression
+     * that fails; the ones after it are evaluated one by one.
+     */
+    int n = var->m_exprIndex;
+    for (ExprValue* partExpr : values)
+    {
+	if (n < var->m_type->m_numExprs) {
+	    /* we only allow simple values at the moment */
+	    if (!partExpr || partExpr->m_child) {
+		var->m_partialValue += QStringLiteral("?""?""?");
+	    } else {
+		var->m_partialValue += partExpr->m_value;
+	    }
+	    n++;
+	    var->m_partialValue += var->m_type->m_displayString[n];
+	}
+	delete partExpr;
+    }
+    var->m_exprIndex = n;
+    var->m_exprIndexUseGuard = true;
+
+    if (var->m_exprIndex < var->m_type->m_numExprs) {
+	evalStructExpression(var, cmd->m_exprWnd, true);
+	return;
+    }
+
+    cmd->m_exprWnd->updateStructValue(var);
+
+    evalExpressions();			/* enqueue dereferenced pointers */
+}
+
+/*
+ * Returns the number of the debugger command that evaluates all
+ * expressions of the type in one go. It is defined when the type is
+ * used for the first time. Returns -1 if the type does not qualify.
+ */
+int KDebugger::structBatchCommand(const TypeInfo* type)
+{
+    auto it = m_structBatchCmds.find(type);
+    if (it != m_structBatchCmds.end())
+	return it->second;
+
+    int cmdNo = -1;
+    QString exprs;
+    /*
+     * A single expression gains nothing. Guards cannot be batched because
+     * the expressions after an error would not be evaluated.
+     */
+    if (m_d->canBatchStructExprs() && type->m_numExprs > 1)
+    {
+	for (int i = 0; i < type->m_numExprs; i++) {
+	    const QString& expr = type->m_exprStrings[i];
+	    if (!type->m_guardStrings[i].isEmpty() ||
+		expr.startsWith(QLatin1String("/QString::Data ")) ||
+		expr.contains(QLatin1Char('\n')))
+	    {
+		exprs.clear();
+		break;
+	    }
+	    exprs += expr + QLatin1Char('\n');
+	}
+    }
+    if (!exprs.isEmpty()) {
+	cmdNo = int(m_structBatchCmds.size());
+	m_d->executeCmd(DCdefineStruct, exprs, cmdNo);
+    }
+    m_structBatchCmds[type] = cmdNo;
+    return cmdNo;
+}
+
+/*
+ * The struct is passed as argument to a user-defined command, which splits
+ * its arguments at blanks and quotes.
+ */
+static bool isSingleWord(const QString& expr)
+{
+    for (QChar c : expr) {
+	if (c.isSpace() || c == QLatin1Char('"') || c == QLatin1Char('\''))
+	    return false;
+    }
+    return !expr.isEmpty();
+}
+
+/*
+ * Queues the first printStruct command for a struct. Returns false if no
+ * command was necessary because the value is known from the members.
+ */
+bool KDebugger::evalInitialStructExpression(VarTree* var, ExprWnd* wnd, bool immediate)
 {
     var->m_exprIndex = 0;
     if (var->m_type != TypeInfo::wchartType())
     {
 	var->m_exprIndexUseGuard = true;
 	var->m_partialValue = var->m_type->m_displayString[0];
-	evalStructExpression(var, wnd, immediate);
+
+	if (evalStructExprsFromMembers(var)) {
+	    wnd->updateStructValue(var);
+	    return false;
+	}
+	if (var->m_exprIndex > 0) {
+	    // the rest is evaluated one by one
+	    evalStructExpression(var, wnd, immediate);
+	    return true;
+	}
+
+	QString base = var->computeExpr();
+	int batch = structBatchCommand(var->m_type);
+	if (batch < 0 || !isSingleWord(base)) {
+	    evalStructExpression(var, wnd, immediate);
+	    return true;
+	}
+	CmdQueueItem* cmd = immediate  ?
+				m_d->queueCmdPrio(DCprintStructBatch, base, batch)  :
+				m_d->queueCmd(DCprintStructBatch, base, batch)  ;
+	// remember which expression this was
+	cmd->m_expr = var;
+	cmd->m_exprWnd = wnd;
     }
     else
     {
@@ -1766,6 +2320,7 @@ void KDebugger::evalInitialStructExpression(VarTree* var, ExprWnd* wnd, bool imm
 	cmd->m_expr = var;
 	cmd->m_exprWnd = wnd;
     }
+    return true;
 }
 
 /** queues a printStruct command; var must have been initialized correctly */
@@ -1818,9 +2373,17 @@ void KDebugger::evalStructExpression(VarTree* var, ExprWnd* wnd, bool immediate)
 void KDebugger::handleSharedLibs(const char* output)
 {
     // parse the table of shared libraries
-    m_sharedLibs = m_d->parseSharedLibs(output);
+    QStringList libs = m_d->parseSharedLibs(output);
     m_sharedLibsListed = true;
 
+    // new libraries can bring symbols that were missing so far
+    if (libs != m_sharedLibs) {
+	m_missingSymbols.clear();
+	for (auto& ws : m_watchScopes)
+	    ws.second.failedScope.clear();
+    }
+    m_sharedLibs = libs;
+
     // get type libraries
     m_typeTable->loadLibTypes(m_sharedLibs);
 
@@ -1836,10 +2399,23 @@ CmdQueueItem* KDebugger::loadCoreFile()
 void KDebugger::slotExpanding(QTreeWidgetItem* item)
 {
     VarTree* exprItem = static_cast<VarTree*>(item);
+    ExprWnd* wnd = static_cast<ExprWnd*>(item->treeWidget());
+    if (exprItem->hasPendingChildren() && m_typeTable) {
+	wnd->materializeChildren(exprItem, *m_typeTable);
+	if (wnd == &m_localVariables)
+	    restoreLocalsExpansion(exprItem, false);
+	// the new children may need types and struct values
+	if (m_programActive && m_d->isIdle())
+	    evalExpressions();
+	return;
+    }
+    if (exprItem->isArrayContinuation()) {
+	fetchArraySlice(wnd, exprItem);
+	return;
+    }
     if (exprItem->m_varKind != VarTree::VKpointer) {
 	return;
     }
-    ExprWnd* wnd = static_cast<ExprWnd*>(item->treeWidget());
     dereferencePointer(wnd, exprItem, true);
 }
 
@@ -1880,6 +2456,7 @@ void KDebugger::slotDeleteWatch()
     if (i != m_watchEvalExpr.end()) {
 	m_watchEvalExpr.erase(i);
     }
+    m_watchScopes.erase(item->getText());
     m_watchVariables.removeExpr(item);
     // item is invalid at this point!
 }
@@ -2090,6 +2667,17 @@ void KDebugger::slotDisassemble(const QString& fileName, int lineNo)
     }
 }
 
+// the number of bytes that are disassembled when there is no function
+static const int disassPageSize = 256;
+
+void KDebugger::slotDisassembleFunction(const DbgAddr& address)
+{
+    if (m_haveExecutable) {
+	CmdQueueItem* cmd = m_d->queueCmd(DCdisassembleFunc, address.asString());
+	cmd->m_addr = address;
+    }
+}
+
 void KDebugger::submitDisassemblyFlavor()
 {
     QString flavor = m_flavor;
@@ -2139,10 +2727,36 @@ void KDebugger::handleInfoTarget(const char* output)
 
 void KDebugger::handleDisassemble(CmdQueueItem* cmd, const char* output)
 {
+    if (!cmd->m_addr.isEmpty()) {
+	// a page of code that is not in a function, see below
+	handleDisassembleFunction(cmd, output);
+	return;
+    }
     Q_EMIT disassembled(cmd->m_fileName, cmd->m_lineNo,
 		      m_d->parseDisassemble(output));
 }
 
+void KDebugger::handleDisassembleFunction(CmdQueueItem* cmd, const char* output)
+{
+    std::list<DisassembledCode> code = m_d->parseDisassemble(output);
+    if (code.empty() || code.front().address.isEmpty()) {
+	// error message
+	code.clear();
+	if (cmd->m_cmd == DCdisassembleFunc) {
+	    /*
+	     * There is no function at the address, e.g., in code without
+	     * symbols. Fetch a page of code that starts at the address.
+	     */
+	    QString start = cmd->m_addr.asString();
+	    QString end = start + QStringLiteral("+") + QString::number(disassPageSize);
+	    CmdQueueItem* c = m_d->queueCmd(DCdisassemble, start, end);
+	    c->m_addr = cmd->m_addr;
+	    return;
+	}
+    }
+    Q_EMIT disassembledFunction(cmd->m_addr, code);
+}
+
 void KDebugger::handleThreadList(const char* output)
 {
     Q_EMIT threadsChanged(m_d->parseThreadList(output));
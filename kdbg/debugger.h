@@ -7,6 +7,7 @@
 #ifndef DEBUGGER_H
 #define DEBUGGER_H
 
+#include <QSet>
 #include <QStringList>
 #include <list>
 #include <map>
@@ -376,6 +377,22 @@ protected:
     void writeCommand();
     
     std::list<QString> m_watchEvalExpr;	/* exprs to evaluate for watch window */
+    /**
+     * What is known about a watch expression: the symbols it refers to,
+     * and the scope (see m_localsScope) in which the debugger could not
+     * resolve one of them.
+     */
+    struct WatchScope {
+	QStringList symbols;
+	bool haveSymbols = false;
+	QString failedScope;
+    };
+    std::map<QString,WatchScope> m_watchScopes;	/* keyed by the expression */
+    QString m_localsScope;		/* function and names of the displayed locals */
+    QSet<QString> m_missingSymbols;	/* symbols that are unknown in m_localsScope */
+    bool isWatchOutOfScope(const QString& expr);
+    int m_localsBudget = 0;		/* updates of locals before watches get a turn */
+    int m_watchBudget = 0;		/* same for the watch window */
     std::list<Breakpoint> m_brkpts;
     QString m_memoryExpression;		/* memory location to watch */
     unsigned m_memoryFormat;		/* how that output should look */
@@ -391,28 +408,36 @@ protected:
     void updateProgEnvironment(const QString& args, const QString& wd,
 			       const std::map<QString,EnvVar>& newVars);
     void parseLocals(const char* output, std::list<ExprValue*>& newVars);
+    QHash<QString,QByteArray> m_localsPrinted;	/* see DebuggerDriver::parseLocals() */
     void handleLocals(const char* output);
     bool handlePrint(CmdQueueItem* cmd, const char* output);
     bool handlePrintPopup(CmdQueueItem* cmd, const char* output);
     bool handlePrintDeref(CmdQueueItem* cmd, const char* output);
+    void handlePrintSlice(CmdQueueItem* cmd, const char* output);
     void handleBacktrace(const char* output);
     void handleFrameChange(const char* output);
     void handleFindType(CmdQueueItem* cmd, const char* output);
     void handlePrintStruct(CmdQueueItem* cmd, const char* output);
+    void handlePrintStructBatch(CmdQueueItem* cmd, const char* output);
     void handleSharedLibs(const char* output);
     void handleRegisters(const char* output);
     void handleMemoryDump(const char* output);
     void handleInfoLine(CmdQueueItem* cmd, const char* output);
     void handleInfoTarget(const char* output);
     void handleDisassemble(CmdQueueItem* cmd, const char* output);
+    void handleDisassembleFunction(CmdQueueItem* cmd, const char* output);
     void handleThreadList(const char* output);
     void handleSetPC(const char* output);
     void handleSetVariable(CmdQueueItem* cmd, const char* output);
     void handleSetDisassFlavor(const char* output);
     void evalExpressions();
-    void evalInitialStructExpression(VarTree* var, ExprWnd* wnd, bool immediate);
+    bool evalInitialStructExpression(VarTree* var, ExprWnd* wnd, bool immediate);
     void evalStructExpression(VarTree* var, ExprWnd* wnd, bool immediate);
+    int structBatchCommand(const TypeInfo* type);
+    bool evalNextUpdate(ExprWnd* wnd);
+    void resetExprBudgets();
     void dereferencePointer(ExprWnd* wnd, VarTree* var, bool immediate);
+    void fetchArraySlice(ExprWnd* wnd, VarTree* more);
     void determineType(ExprWnd* wnd, VarTree* var);
     void queueMemoryDump(bool immediate, bool update);
     CmdQueueItem* loadCoreFile();
@@ -451,6 +476,28 @@ protected:
     std::map<QString,QString> m_envVars;	/* environment variables set by user */
     QStringList m_sharedLibs;		/* shared libraries used by program */
     ProgramTypeTable* m_typeTable = {};	/* known types used by the program */
+    /**
+     * The number of the debugger command that evaluates all expressions
+     * of a type at once, or -1 if there is none.
+     */
+    std::map<const TypeInfo*,int> m_structBatchCmds;
+    QString m_frameFunction;		/* function of the selected frame */
+    QStringList m_stackFunctions;	/* functions of the frames of the backtrace */
+    QString m_localsFunction;		/* function whose locals are displayed */
+    /**
+     * The paths of the items in the locals window that were expanded,
+     * per function. See saveLocalsExpansion(). Only the functions that
+     * were used most recently are remembered.
+     */
+    struct ExpandedLocals {
+	QSet<QString> paths;
+	quint64 lastUse = 0;
+    };
+    std::map<QString,ExpandedLocals> m_expandedLocals;
+    quint64 m_expansionClock = 0;	/* increments with each use */
+    ExpandedLocals& useExpandedLocals(const QString& func);
+    void saveLocalsExpansion();
+    void restoreLocalsExpansion(VarTree* item, bool exact);
     KConfig* m_programConfig = {};	/* program-specific settings (brkpts etc) */
     void saveProgramSettings();
     void restoreProgramSettings();
@@ -470,6 +517,7 @@ protected Q_SLOTS:
     void slotDeleteWatch();
     void slotValuePopup(const QString&);
     void slotDisassemble(const QString&, int);
+    void slotDisassembleFunction(const DbgAddr& address);
     void slotValueEdited(VarTree*, const QString&);
 public Q_SLOTS:
     void setThread(int);
@@ -557,6 +605,13 @@ Q_SIGNALS:
      */
     void disassembled(const QString& file, int line, const std::list<DisassembledCode>& code);
 
+    /**
+     * Provides the disassembled code of the function that contains the
+     * address. If there is no such function, the code that follows the
+     * address is provided. The code is empty if the address is invalid.
+     */
+    void disassembledFunction(const DbgAddr& address, const std::list<DisassembledCode>& code);
+
     /**
      * This informs any listener that a change in disassembly flavor occured
      */
@@ -0,0 +1,221 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "disasswnd.h"
+#include "debugger.h"
+#include <kiconloader.h>
+#include <klocalizedstring.h>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QHash>
+#include <QHeaderView>
+#include "mydebug.h"
+
+enum { COL_ADDR, COL_CODE };
+
+// the cache is dropped when it holds this many functions
+static const int maxCachedFunctions = 200;
+
+DisassemblyWindow::DisassemblyWindow(QWidget* parent) :
+	QTreeWidget(parent)
+{
+    setHeaderLabels(QStringList()
+	<< i18n("Address")
+	<< i18n("Code"));
+    header()->setSectionResizeMode(COL_ADDR, QHeaderView::ResizeToContents);
+    setRootIsDecorated(false);
+    setAllColumnsShowFocus(true);
+    setUniformRowHeights(true);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+    m_pcinner = KIconLoader::global()->loadIcon(QStringLiteral("pcinner"), KIconLoader::User);
+    m_pcup = KIconLoader::global()->loadIcon(QStringLiteral("pcup"), KIconLoader::User);
+    m_brkena = KIconLoader::global()->loadIcon(QStringLiteral("brkena"), KIconLoader::User);
+    m_brkdis = KIconLoader::global()->loadIcon(QStringLiteral("brkdis"), KIconLoader::User);
+}
+
+DisassemblyWindow::~DisassemblyWindow()
+{
+}
+
+bool DisassemblyWindow::sameFile(const QString& file1, const QString& file2) const
+{
+    // the backtrace does not always list the full path
+    return QFileInfo(file1).fileName() == QFileInfo(file2).fileName();
+}
+
+/*
+ * The backtrace does not list the address of the innermost frame if the
+ * program stopped at the beginning of a line. The location that the
+ * debugger reports when it stops has it, though.
+ */
+void DisassemblyWindow::updatePC(const QString& fileName, int lineNo,
+				 const DbgAddr& address, int frameNo)
+{
+    m_pc = address;
+    m_pcFrame = frameNo;
+    m_pcFile = fileName;
+    m_pcLine = lineNo;
+    if (m_pc.isEmpty() && lineNo >= 0 &&
+	lineNo == m_markerLine && sameFile(fileName, m_markerFile))
+    {
+	m_pc = m_markerAddress;
+    }
+    m_markerLine = -1;			/* use it only once */
+
+    if (isVisible())
+	showPC();
+}
+
+void DisassemblyWindow::slotActivateFileLine(const QString& fileName, int lineNo,
+					     const DbgAddr& address)
+{
+    m_markerFile = fileName;
+    m_markerLine = lineNo;
+    m_markerAddress = address;
+
+    // a frame change reports the PC before the location
+    if (m_pc.isEmpty() && m_pcLine >= 0 &&
+	lineNo == m_pcLine && sameFile(fileName, m_pcFile))
+    {
+	m_pc = address;
+	m_markerLine = -1;
+	if (isVisible())
+	    showPC();
+    }
+}
+
+void DisassemblyWindow::showEvent(QShowEvent* ev)
+{
+    QTreeWidget::showEvent(ev);
+    showPC();
+}
+
+void DisassemblyWindow::showPC()
+{
+    if (m_pc.isEmpty()) {
+	updateMarkers();
+	return;
+    }
+
+    auto it = m_index.find(m_pc);
+    if (it != m_index.end()) {
+	showFunction(it->second.func);
+	updateMarkers();
+	scrollToItem(topLevelItem(it->second.row));
+    } else {
+	updateMarkers();		/* remove the old PC */
+	// ask only once; the code need not contain the address exactly
+	if (!(m_pc == m_requested)) {
+	    m_requested = m_pc;
+	    Q_EMIT disassemble(m_pc);
+	}
+    }
+}
+
+void DisassemblyWindow::slotDisassembled(const DbgAddr& address,
+					 const std::list<DisassembledCode>& code)
+{
+    if (int(m_functions.size()) >= maxCachedFunctions) {
+	TRACE("dropping disassembled functions");
+	m_functions.clear();
+	m_index.clear();
+	m_shownFunction = -1;
+    }
+
+    int func = -1;
+    if (!code.empty()) {
+	func = m_functions.size();
+	m_functions.emplace_back(code.begin(), code.end());
+	std::vector<DisassembledCode>& fc = m_functions.back();
+	for (size_t i = 0; i < fc.size(); i++) {
+	    QString& c = fc[i].code;
+	    while (c.endsWith(QLatin1Char('\n')))
+		c.truncate(c.length()-1);
+	    // the first function that has an address keeps it
+	    m_index.emplace(fc[i].address, Location{ func, int(i) });
+	}
+    }
+
+    if (!(address == m_pc))
+	return;				/* the program has moved on */
+
+    if (func < 0) {
+	// no code at the PC
+	clear();
+	m_shownFunction = -1;
+	return;
+    }
+    showFunction(func);
+    updateMarkers();
+    auto it = m_index.find(m_pc);
+    if (it != m_index.end() && it->second.func == func)
+	scrollToItem(topLevelItem(it->second.row));
+}
+
+void DisassemblyWindow::showFunction(int func)
+{
+    if (func == m_shownFunction)
+	return;
+    m_shownFunction = func;
+
+    clear();
+    QList<QTreeWidgetItem*> items;
+    for (const DisassembledCode& c : m_functions[func]) {
+	items.append(new QTreeWidgetItem(QStringList()
+		<< c.address.asString()
+		<< c.code));
+    }
+    addTopLevelItems(items);
+}
+
+/*
+ * Sets the PC and breakpoint icons of the shown function.
+ */
+void DisassemblyWindow::updateMarkers()
+{
+    if (m_shownFunction < 0)
+	return;
+
+    QHash<QString,bool> brkpts;		/* address -> enabled */
+    if (m_debugger) {
+	for (auto bp = m_debugger->breakpointsBegin(); bp != m_debugger->breakpointsEnd(); ++bp)
+	{
+	    if (!bp->address.isEmpty())
+		brkpts[bp->address.a] = bp->enabled;
+	}
+    }
+
+    const std::vector<DisassembledCode>& fc = m_functions[m_shownFunction];
+    for (size_t i = 0; i < fc.size(); i++) {
+	QTreeWidgetItem* item = topLevelItem(i);
+	if (!m_pc.isEmpty() && fc[i].address == m_pc) {
+	    item->setIcon(COL_ADDR, m_pcFrame == 0  ?  m_pcinner  :  m_pcup);
+	} else {
+	    auto bp = brkpts.constFind(fc[i].address.a);
+	    if (bp != brkpts.constEnd())
+		item->setIcon(COL_ADDR, *bp  ?  m_brkena  :  m_brkdis);
+	    else
+		item->setIcon(COL_ADDR, QIcon());
+	}
+    }
+}
+
+void DisassemblyWindow::updateBreakpoints()
+{
+    updateMarkers();
+}
+
+void DisassemblyWindow::clearCache()
+{
+    m_functions.clear();
+    m_index.clear();
+    m_shownFunction = -1;
+    m_requested = DbgAddr();
+    clear();
+    if (isVisible())
+	showPC();
+}
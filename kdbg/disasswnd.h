@@ -0,0 +1,87 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef DISASSWND_H
+#define DISASSWND_H
+
+#include <QPixmap>
+#include <QTreeWidget>
+#include <list>
+#include <map>
+#include <vector>
+#include "dbgdriver.h"			/* DbgAddr, DisassembledCode */
+
+class KDebugger;
+
+/**
+ * Shows the disassembled code of the function that contains the program
+ * counter of the selected frame.
+ *
+ * Each function is requested from the debugger only once. The functions
+ * are kept until the program or the disassembly flavor changes, and an
+ * index of the addresses of their instructions finds the function of the
+ * program counter without asking the debugger, for example, while the
+ * program is stepped by instruction. Code is requested only while the
+ * window is visible.
+ */
+class DisassemblyWindow : public QTreeWidget
+{
+    Q_OBJECT
+public:
+    DisassemblyWindow(QWidget* parent);
+    ~DisassemblyWindow();
+
+    void setDebugger(KDebugger* deb) { m_debugger = deb; }
+
+protected:
+    KDebugger* m_debugger = {};
+
+    struct AddrLess {
+	bool operator()(const DbgAddr& a1, const DbgAddr& a2) const { return a2 > a1; }
+    };
+    struct Location {
+	int func;			/* index into m_functions */
+	int row;			/* index into the code of the function */
+    };
+    /** The cached functions; the code is in the order of the debugger. */
+    std::vector<std::vector<DisassembledCode>> m_functions;
+    /** The instructions of all cached functions, sorted by address. */
+    std::map<DbgAddr,Location,AddrLess> m_index;
+    int m_shownFunction = -1;		//!< The function in the window
+
+    DbgAddr m_pc;			//!< The PC of the selected frame
+    int m_pcFrame = 0;
+    QString m_pcFile;
+    int m_pcLine = -1;			//!< -1 if no PC
+    DbgAddr m_requested;		//!< The address whose code was requested last
+    QString m_markerFile;		//!< The location that the debugger reported last
+    int m_markerLine = -1;
+    DbgAddr m_markerAddress;
+
+    QPixmap m_pcinner;			/* PC at innermost frame */
+    QPixmap m_pcup;			/* PC at frame up the stack */
+    QPixmap m_brkena;			/* enabled breakpoint */
+    QPixmap m_brkdis;			/* disabled breakpoint */
+
+    void showEvent(QShowEvent* ev) override;
+    void showPC();
+    void showFunction(int func);
+    void updateMarkers();
+    bool sameFile(const QString& file1, const QString& file2) const;
+
+public Q_SLOTS:
+    void updatePC(const QString& fileName, int lineNo, const DbgAddr& address, int frameNo);
+    void slotActivateFileLine(const QString& fileName, int lineNo, const DbgAddr& address);
+    void slotDisassembled(const DbgAddr& address, const std::list<DisassembledCode>& code);
+    void updateBreakpoints();
+    void clearCache();
+
+Q_SIGNALS:
+    /** Requests the disassembled code of the function at the address. */
+    void disassemble(const DbgAddr& address);
+};
+
+#endif // DISASSWND_H
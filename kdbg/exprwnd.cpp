@@ -6,12 +6,17 @@
 
 #include "exprwnd.h"
 #include "typetable.h"
+#include <QHash>
 #include <QHeaderView>
 #include <QPainter>
 #include <QPaintEvent>
 #include <QFocusEvent>
 #include <QKeyEvent>
 #include <QScrollBar>
+#include <QSet>
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <kiconloader.h>		/* icons */
 #include <klocalizedstring.h>		/* i18n */
 #include "mydebug.h"
@@ -24,11 +29,12 @@ VarTree::VarTree(VarTree* parent, ExprValue* v) :
 	m_exprIndexUseGuard(false),
 	m_baseValue(v->m_value),
 	m_baseChanged(false),
-	m_structChanged(false)
+	m_structChanged(false),
+	m_outOfScope(false)
 {
     setText(v->m_name);
     updateValueText();
-    if (v->m_child || m_varKind == VarTree::VKpointer)
+    if (v->m_child || m_varKind == VarTree::VKpointer || isArrayContinuation())
 	setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
     else
 	setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicator);
@@ -43,7 +49,8 @@ VarTree::VarTree(ExprWnd* parent, ExprValue* v) :
 	m_exprIndexUseGuard(false),
 	m_baseValue(v->m_value),
 	m_baseChanged(false),
-	m_structChanged(false)
+	m_structChanged(false),
+	m_outOfScope(false)
 {
     setText(v->m_name);
     updateValueText();
@@ -51,6 +58,7 @@ VarTree::VarTree(ExprWnd* parent, ExprValue* v) :
 
 VarTree::~VarTree()
 {
+    delete m_pendingChildren;
 }
 
 QString VarTree::computeExpr() const
@@ -127,10 +135,6 @@ bool VarTree::updateValue(const QString& newValue)
     bool prevValueChanged = m_baseChanged;
     if ((m_baseChanged = m_baseValue != newValue)) {
 	m_baseValue = newValue;
-	updateValueText();
-	setForeground(1, QBrush(QColor(Qt::red)));
-    } else if (prevValueChanged) {
-	setForeground(1, treeWidget()->palette().text());
     }
     /*
      * We must repaint the cell if the value changed. If it did not change,
@@ -138,7 +142,10 @@ bool VarTree::updateValue(const QString& newValue)
      * because the color of the display must be changed (from red to
      * black).
      */
-    return m_baseChanged || prevValueChanged;
+    bool repaint = m_baseChanged || prevValueChanged;
+    if (repaint)
+	updateValueText();
+    return repaint;
 }
 
 bool VarTree::updateStructValue(const QString& newValue)
@@ -147,10 +154,6 @@ bool VarTree::updateStructValue(const QString& newValue)
     bool prevValueChanged = m_structChanged;
     if ((m_structChanged = m_structValue != newValue)) {
 	m_structValue = newValue;
-	updateValueText();
-	setForeground(1, QBrush(QColor(Qt::red)));
-    } else if (prevValueChanged) {
-	setForeground(1, treeWidget()->palette().text());
     }
     /*
     * We must repaint the cell if the value changed. If it did not change,
@@ -158,7 +161,10 @@ bool VarTree::updateStructValue(const QString& newValue)
     * because the color of the display must be changed (from red to
     * black).
     */
-    return m_structChanged || prevValueChanged;
+    bool repaint = m_structChanged || prevValueChanged;
+    if (repaint)
+	updateValueText();
+    return repaint;
 }
 
 QString VarTree::displayedValue() const
@@ -171,9 +177,30 @@ QString VarTree::displayedValue() const
     return text;
 }
 
+/*
+ * The value column is not stored in the item; data() computes it from
+ * m_baseValue and m_structValue. We only tell the view about the change.
+ */
 void VarTree::updateValueText()
 {
-    setText(1, displayedValue());
+    emitDataChanged();
+}
+
+void VarTree::setText(const QString& t)
+{
+    /*
+     * Only the names of members are shared. The addresses of dereferenced
+     * pointers and the indexes of array elements are different in each
+     * item, and top-level names occur only once.
+     */
+    ExprWnd* wnd = static_cast<ExprWnd*>(treeWidget());
+    if (!wnd || !parent() || m_nameKind == NKaddress ||
+	(m_nameKind == NKplain && t.startsWith(QLatin1Char('['))))
+    {
+	QTreeWidgetItem::setText(0, t);
+    } else {
+	QTreeWidgetItem::setText(0, wnd->internName(t));
+    }
 }
 
 void VarTree::inferTypesOfChildren(ProgramTypeTable& typeTable)
@@ -232,6 +259,36 @@ void VarTree::inferTypesOfChildren(ProgramTypeTable& typeTable)
     }
 }
 
+/*
+ * The elements of plain arrays that gdb did not print can be requested
+ * piecemeal. Pretty-printed containers show a value such as "std::vector of
+ * length 1000" and cannot be indexed in the same way.
+ */
+bool VarTree::isArrayContinuation() const
+{
+    // NKmore occurs only in arrays
+    const VarTree* par = static_cast<const VarTree*>(parent());
+    return m_nameKind == NKmore && par && par->value().isEmpty();
+}
+
+int VarTree::nextArrayIndex() const
+{
+    // the name is "[12]" or "[12 .. 15]"; we need the last index
+    QString name = getText();
+    int from = name.lastIndexOf(QLatin1Char(' ')) + 1;
+    if (from == 0)
+	from = 1;			/* skip the '[' */
+    return name.mid(from, name.length()-1-from).toInt() + 1;
+}
+
+int VarTree::valueChildCount() const
+{
+    int n = childCount();
+    for (ExprValue* v = m_pendingChildren; v; v = v->m_next)
+	++n;
+    return n;
+}
+
 // the value contains the pointer type in parenthesis
 bool VarTree::isWcharT() const
 {
@@ -262,11 +319,32 @@ const TypeInfo* VarTree::inferTypeFromBaseClass()
     return nullptr;
 }
 
+void VarTree::setOutOfScope(bool outOfScope)
+{
+    if (m_outOfScope == outOfScope)
+	return;
+    m_outOfScope = outOfScope;
+    emitDataChanged();
+}
+
 QVariant VarTree::data(int column, int role) const
 {
-    if (role != Qt::ToolTipRole || column != 1)
+    if (role == Qt::ForegroundRole && m_outOfScope && treeWidget())
+	return QVariant(treeWidget()->palette().brush(QPalette::Disabled, QPalette::Text));
+    if (column != 1)
+	return QTreeWidgetItem::data(column, role);
+    switch (role) {
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+	return QVariant(displayedValue());
+    case Qt::ForegroundRole:
+	// changed values are red, the others use the default color
+	if (m_baseChanged || m_structChanged)
+	    return QVariant(QBrush(QColor(Qt::red)));
+	return QVariant();
+    default:
 	return QTreeWidgetItem::data(column, role);
-    return QVariant(displayedValue());
+    }
 }
 
 ExprValue::ExprValue(const QString& name, VarTree::NameKind aKind) :
@@ -280,7 +358,150 @@ ExprValue::ExprValue(const QString& name, VarTree::NameKind aKind) :
 ExprValue::~ExprValue()
 {
     delete m_child;
-    delete m_next;
+    // delete the siblings one by one; recursion would exhaust the stack
+    // with long arrays
+    ExprValue* v = m_next;
+    while (v) {
+	ExprValue* next = v->m_next;
+	v->m_next = nullptr;
+	delete v;
+	v = next;
+    }
+}
+
+/*
+ * The parsers allocate a node for every member and array element of a
+ * value, and the trees are thrown away as soon as the expression windows
+ * have been updated. Therefore, the nodes are carved from large blocks.
+ * A block is released as soon as its last node is gone, so that nodes
+ * that are kept for a long time (e.g., the elements of collapsed arrays)
+ * do not pin the blocks of all trees that were ever parsed.
+ * The pool is used only by the GUI thread.
+ */
+namespace {
+class ExprValuePool
+{
+    union Slot {
+	Slot* next;			/* when the slot is free */
+	alignas(ExprValue) char storage[sizeof(ExprValue)];
+    };
+    static const size_t blockSize = 1024;
+    struct Block {
+	std::unique_ptr<Slot[]> slots;
+	size_t used = 0;		/* slots handed out so far */
+	Slot* free = {};		/* slots that were released */
+	size_t live = 0;		/* nodes currently allocated */
+	Block* prev = {};		/* in m_avail */
+	Block* next = {};
+	bool isFull() const { return !free && used == blockSize; }
+    };
+    std::map<const Slot*,Block> m_blocks;	/* keyed by the first slot */
+    Block* m_avail = {};		/* the blocks that are not full */
+
+    void link(Block* b);
+    void unlink(Block* b);
+
+public:
+    void* allocate();
+    void release(void* p);
+};
+}
+
+void ExprValuePool::link(Block* b)
+{
+    b->prev = nullptr;
+    b->next = m_avail;
+    if (m_avail)
+	m_avail->prev = b;
+    m_avail = b;
+}
+
+void ExprValuePool::unlink(Block* b)
+{
+    if (b->prev)
+	b->prev->next = b->next;
+    else
+	m_avail = b->next;
+    if (b->next)
+	b->next->prev = b->prev;
+    b->prev = b->next = nullptr;
+}
+
+void* ExprValuePool::allocate()
+{
+    if (!m_avail) {
+	Block b;
+	b.slots.reset(new Slot[blockSize]);
+	const Slot* key = b.slots.get();
+	link(&m_blocks.emplace(key, std::move(b)).first->second);
+    }
+    Block& b = *m_avail;
+    ++b.live;
+    Slot* s;
+    if (b.free) {
+	s = b.free;
+	b.free = s->next;
+    } else {
+	s = &b.slots[b.used++];
+    }
+    if (b.isFull())
+	unlink(&b);
+    return s;
+}
+
+void ExprValuePool::release(void* p)
+{
+    Slot* s = static_cast<Slot*>(p);
+    // find the block that contains the slot
+    auto it = m_blocks.upper_bound(s);
+    ASSERT(it != m_blocks.begin());
+    --it;
+    Block& b = it->second;
+    ASSERT(s < b.slots.get() + blockSize);
+    bool wasFull = b.isFull();
+    if (--b.live == 0) {
+	if (&b == m_avail) {
+	    // the next nodes are allocated from it; start over
+	    b.used = 0;
+	    b.free = nullptr;
+	} else {
+	    if (!wasFull)
+		unlink(&b);
+	    m_blocks.erase(it);
+	}
+	return;
+    }
+    s->next = b.free;
+    b.free = s;
+    if (wasFull)
+	link(&b);
+}
+
+/*
+ * The pool is never destroyed: expression trees that are still alive
+ * when the static objects are destroyed at exit release their nodes to it.
+ */
+static ExprValuePool& exprValuePool()
+{
+    static ExprValuePool* pool = new ExprValuePool;
+    return *pool;
+}
+
+void* ExprValue::operator new(size_t size)
+{
+    if (size != sizeof(ExprValue))
+	return ::operator new(size);
+    return exprValuePool().allocate();
+}
+
+void ExprValue::operator delete(void* p, size_t size)
+{
+    if (!p)
+	return;
+    if (size != sizeof(ExprValue))
+	::operator delete(p);
+    else
+	exprValuePool().release(p);
 }
 
 void ExprValue::appendChild(ExprValue* newChild)
@@ -324,9 +545,31 @@ ExprWnd::ExprWnd(QWidget* parent, const QString& colHeader) :
     setRootIsDecorated(true);
     setAllColumnsShowFocus(true);
 
-    m_pixPointer = KIconLoader::global()->loadIcon(QStringLiteral("pointer.xpm"), KIconLoader::User);
-    if (m_pixPointer.isNull())
+    QPixmap pixPointer = KIconLoader::global()->loadIcon(QStringLiteral("pointer.xpm"), KIconLoader::User);
+    if (pixPointer.isNull())
 	TRACE("Can't load pointer.xpm");
+    m_iconPointer = QIcon(pixPointer);
+
+    m_repaintTimer.setSingleShot(true);
+    connect(&m_repaintTimer, SIGNAL(timeout()), SLOT(flushRepaint()));
+}
+
+// milliseconds between repaints while values arrive
+static const int repaintInterval = 20;
+
+void ExprWnd::deferRepaint()
+{
+    if (m_repaintTimer.isActive())
+	return;
+    viewport()->setUpdatesEnabled(false);
+    m_repaintTimer.start(repaintInterval);
+}
+
+void ExprWnd::flushRepaint()
+{
+    m_repaintTimer.stop();
+    // this repaints the viewport if it was disabled
+    viewport()->setUpdatesEnabled(true);
 }
 
 ExprWnd::~ExprWnd()
@@ -345,6 +588,8 @@ QStringList ExprWnd::exprList() const
 
 VarTree* ExprWnd::insertExpr(ExprValue* expr, ProgramTypeTable& typeTable)
 {
+    deferRepaint();
+
     // append a new dummy expression
     VarTree* display = new VarTree(this, expr);
 
@@ -355,6 +600,8 @@ VarTree* ExprWnd::insertExpr(ExprValue* expr, ProgramTypeTable& typeTable)
 
 void ExprWnd::updateExpr(ExprValue* expr, ProgramTypeTable& typeTable)
 {
+    deferRepaint();
+
     // search the root variable
     VarTree* item = nullptr;
     for (int i = 0; i < topLevelItemCount(); i++)
@@ -374,10 +621,47 @@ void ExprWnd::updateExpr(ExprValue* expr, ProgramTypeTable& typeTable)
 
 void ExprWnd::updateExpr(VarTree* display, ExprValue* newValues, ProgramTypeTable& typeTable)
 {
+    deferRepaint();
     updateExprRec(display, newValues, typeTable);
     collectUnknownTypes(display);
 }
 
+void ExprWnd::keepExpr(VarTree* display)
+{
+    deferRepaint();
+    keepExprRec(display);
+}
+
+/*
+ * Does what updateExprRec() does when it gets the same values again, but
+ * without comparing them.
+ */
+void ExprWnd::keepExprRec(VarTree* display)
+{
+    checkUnknownType(display);
+
+    if (display->m_varKind == VarTree::VKstruct &&
+	display->m_type &&
+	display->m_type != TypeInfo::unknownType())
+    {
+	if (display->m_type == TypeInfo::wchartType())
+	    display->m_partialValue = QLatin1Char('L');
+	else
+	    display->m_partialValue = display->m_type->m_displayString[0];
+	m_updateStruct.push_back(display);
+    }
+    display->updateValue(display->value());
+
+    // the target of a pointer is printed separately
+    if (display->m_varKind == VarTree::VKpointer) {
+	if (display->isExpanded())
+	    m_updatePtrs.push_back(display);
+	return;
+    }
+    for (int i = 0; i < display->childCount(); i++)
+	keepExprRec(display->child(i));
+}
+
 /*
  * returns true if there's a visible change
  */
@@ -385,6 +669,9 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 {
     bool isExpanded = display->isExpanded();
 
+    if (isExpanded && display->hasPendingChildren())
+	materializeChildren(display, typeTable);
+
     /*
      * If we are updating a pointer without children by a dummy, we don't
      * collapse it, but simply insert the new children. This happens when a
@@ -398,22 +685,26 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 	return;
     }
 
+    // the next two lines mean: not(m_varKind remains unchanged)
+    bool kindChanged = !(newValues->m_varKind == VarTree::VKdummy ||
+			 display->m_varKind == newValues->m_varKind);
+    bool countChanged = display->valueChildCount() != newValues->childCount() &&
+	/*
+	 * If this is a pointer and newValues doesn't have children, we
+	 * don't replace the sub-tree; instead, below we mark this
+	 * sub-tree for requiring an update.
+	 */
+	(display->m_varKind != VarTree::VKpointer || newValues->m_child);
+
     /*
-     * If the display and newValues have different kind or if their number
-     * of children is different, replace the whole sub-tree.
+     * If the display and newValues have different kind, replace the whole
+     * sub-tree. The same happens if the number of children is different
+     * and there are no items to keep on one side. Otherwise, the children
+     * are matched by name below.
      */
-    if (// the next two lines mean: not(m_varKind remains unchanged)
-	!(newValues->m_varKind == VarTree::VKdummy ||
-	  display->m_varKind == newValues->m_varKind)
-	||
-	(display->childCount() != newValues->childCount() &&
-	 /*
-	  * If this is a pointer and newValues doesn't have children, we
-	  * don't replace the sub-tree; instead, below we mark this
-	  * sub-tree for requiring an update.
-	  */
-	 (display->m_varKind != VarTree::VKpointer ||
-	  newValues->m_child)))
+    if (kindChanged ||
+	(countChanged && (display->childCount() == 0 || !newValues->m_child ||
+			  display->hasPendingChildren())))
     {
 	if (isExpanded) {
 	    display->setExpanded(false);
@@ -422,6 +713,9 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 	// since children changed, it is likely that the type has also changed
 	display->m_type = nullptr;	/* will re-evaluate the type */
 
+	// replaceChildren() may take the children away from newValues
+	bool hasChildren = newValues->m_child != nullptr;
+
 	// display the new value
 	updateSingleExpr(display, newValues);
 	replaceChildren(display, newValues);
@@ -429,7 +723,7 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 	// update the m_varKind
 	if (newValues->m_varKind != VarTree::VKdummy) {
 	    display->m_varKind = newValues->m_varKind;
-	    if (newValues->m_child || newValues->m_varKind == VarTree::VKpointer)
+	    if (hasChildren || newValues->m_varKind == VarTree::VKpointer)
 		display->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
 	    else
 		display->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicator);
@@ -442,6 +736,10 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 	return;
     }
 
+    // if members come and go, the struct may well be of a different type
+    if (countChanged && display->m_varKind == VarTree::VKstruct)
+	display->m_type = nullptr;	/* will re-evaluate the type */
+
     // display the new value
     updateSingleExpr(display, newValues);
 
@@ -464,6 +762,19 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
 	}
     }
 
+    if (display->hasPendingChildren()) {
+	// the children are still not shown; keep the new ones instead
+	delete display->m_pendingChildren;
+	display->m_pendingChildren = newValues->m_child;
+	newValues->m_child = nullptr;
+	return;
+    }
+
+    if (countChanged) {
+	updateChildrenByName(display, newValues, typeTable);
+	return;
+    }
+
     ASSERT(display->childCount() == newValues->childCount());
 
     // go for children
@@ -483,6 +794,66 @@ void ExprWnd::updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeT
     }
 }
 
+/*
+ * Updates the children of display from those of newValues when their
+ * number differs, e.g., when an element was appended to a container.
+ * Children are matched by name. Items whose name is gone are removed,
+ * new names get new items, and the matching items are updated in place so
+ * that they keep their expansion state, types, and pending updates.
+ */
+void ExprWnd::updateChildrenByName(VarTree* display, ExprValue* newValues,
+				   ProgramTypeTable& typeTable)
+{
+    QSet<QString> newNames;
+    for (ExprValue* v = newValues->m_child; v; v = v->m_next)
+	newNames.insert(v->m_name);
+
+    // remove the items that do not have a match
+    QHash<QString, VarTree*> oldItems;
+    for (int i = display->childCount()-1; i >= 0; i--)
+    {
+	VarTree* c = display->child(i);
+	if (newNames.contains(c->getText())) {
+	    // of duplicates keep the first one
+	    VarTree*& o = oldItems[c->getText()];
+	    if (o) {
+		unhookSubtree(o);
+		delete o;
+	    }
+	    o = c;
+	} else {
+	    unhookSubtree(c);
+	    delete c;
+	}
+    }
+
+    int pos = 0;
+    for (ExprValue* v = newValues->m_child; v; v = v->m_next, pos++)
+    {
+	VarTree* item = oldItems.take(v->m_name);
+	if (item) {
+	    if (display->child(pos) != item) {
+		// out of order; this is rare
+		bool expanded = item->isExpanded();
+		display->takeChild(display->indexOfChild(item));
+		display->insertChild(pos, item);
+		item->setExpanded(expanded);
+	    }
+	    updateExprRec(item, v, typeTable);
+	} else {
+	    item = new VarTree(display, v);
+	    if (pos < display->childCount()-1) {
+		display->takeChild(display->childCount()-1);
+		display->insertChild(pos, item);
+		item->setExpanded(v->m_initiallyExpanded);
+	    }
+	    replaceChildren(item, v);
+	    item->inferTypesOfChildren(typeTable);
+	}
+    }
+    ASSERT(display->childCount() == pos);
+}
+
 void ExprWnd::updateSingleExpr(VarTree* display, ExprValue* newValue)
 {
     /*
@@ -521,6 +892,8 @@ void ExprWnd::updateStructValue(VarTree* display)
 {
     ASSERT(display->m_varKind == VarTree::VKstruct);
 
+    deferRepaint();
+
     display->updateStructValue(display->m_partialValue);
     // reset the value
     display->m_partialValue.clear();
@@ -536,8 +909,28 @@ void ExprWnd::replaceChildren(VarTree* display, ExprValue* newValues)
 	unhookSubtree(c);
 	delete c;
     }
-    // insert copies of the newValues
-    for (ExprValue* v = newValues->m_child; v; v = v->m_next)
+    delete display->m_pendingChildren;
+    display->m_pendingChildren = nullptr;
+
+    /*
+     * The elements of a collapsed array do not get items until the array
+     * is expanded. Large arrays would otherwise create thousands of items
+     * that are never looked at.
+     */
+    VarTree::VarKind kind = newValues->m_varKind == VarTree::VKdummy ?
+		display->m_varKind : newValues->m_varKind;
+    if (kind == VarTree::VKarray && !display->isExpanded()) {
+	display->m_pendingChildren = newValues->m_child;
+	newValues->m_child = nullptr;
+	return;
+    }
+    insertChildren(display, newValues->m_child);
+}
+
+void ExprWnd::insertChildren(VarTree* display, ExprValue* first)
+{
+    // insert copies of the values
+    for (ExprValue* v = first; v; v = v->m_next)
     {
 	VarTree* vNew = new VarTree(display, v);
 	// recurse
@@ -545,6 +938,87 @@ void ExprWnd::replaceChildren(VarTree* display, ExprValue* newValues)
     }
 }
 
+void ExprWnd::materializeChildren(VarTree* display, ProgramTypeTable& typeTable)
+{
+    ExprValue* pending = display->m_pendingChildren;
+    if (!pending)
+	return;
+    display->m_pendingChildren = nullptr;
+
+    insertChildren(display, pending);
+    delete pending;
+
+    display->inferTypesOfChildren(typeTable);
+    for (int i = 0; i < display->childCount(); i++)
+	collectUnknownTypes(display->child(i));
+}
+
+/*
+ * Adds offset to the indices in an element name, "[12]" or "[12 .. 15]".
+ */
+static QString shiftArrayIndex(const QString& name, int offset)
+{
+    QString inner = name.mid(1, name.length()-2);
+    int dots = inner.indexOf(QLatin1String(" .. "));
+    if (dots < 0)
+	return QLatin1Char('[') + QString::number(inner.toInt() + offset) + QLatin1Char(']');
+    return QLatin1String("[%1 .. %2]").arg(
+		QString::number(inner.left(dots).toInt() + offset),
+		QString::number(inner.mid(dots+4).toInt() + offset));
+}
+
+void ExprWnd::insertArraySlice(VarTree* more, ExprValue* slice, int start, int length,
+			       ProgramTypeTable& typeTable)
+{
+    deferRepaint();
+
+    VarTree* array = static_cast<VarTree*>(more->parent());
+    ASSERT(array);
+
+    /*
+     * If the slice is truncated as well, we keep our own continuation
+     * item; otherwise, there may be more elements if we received as many
+     * as we asked for. An error means that there are no more elements.
+     */
+    bool haveMore = false;
+    int received = 0;
+    ExprValue** link = &slice->m_child;
+    if (slice->m_varKind != VarTree::VKarray)
+	link = nullptr;
+    while (link && *link) {
+	ExprValue* v = *link;
+	if (v->m_nameKind == VarTree::NKmore) {
+	    haveMore = true;
+	    *link = v->m_next;
+	    v->m_next = nullptr;
+	    delete v;
+	    continue;
+	}
+	v->m_name = shiftArrayIndex(v->m_name, start);
+	link = &v->m_next;
+    }
+
+    array->takeChild(array->indexOfChild(more));
+    int first = array->childCount();
+    if (link) {
+	insertChildren(array, slice->m_child);
+	if (array->childCount() > first)
+	    received = array->child(array->childCount()-1)->nextArrayIndex() - start;
+    }
+    for (int i = first; i < array->childCount(); i++) {
+	array->child(i)->inferTypesOfChildren(typeTable);
+	collectUnknownTypes(array->child(i));
+    }
+
+    if (haveMore || received >= length) {
+	array->addChild(more);
+	more->setExpanded(false);
+    } else {
+	unhookSubtree(more);
+	delete more;
+    }
+}
+
 void ExprWnd::collectUnknownTypes(VarTree* var)
 {
     QTreeWidgetItemIterator i(var);
@@ -576,7 +1050,7 @@ void ExprWnd::checkUnknownType(VarTree* var)
     }
     // add pointer pixmap to pointers
     if (var->m_varKind == VarTree::VKpointer) {
-	var->setPixmap(m_pixPointer);
+	var->setIcon(m_iconPointer);
     }
 }
 
@@ -636,6 +1110,7 @@ VarTree* ExprWnd::memberByName(VarTree* v, const QString& name)
 
 void ExprWnd::removeExpr(VarTree* item)
 {
+    deferRepaint();
     unhookSubtree(item);
 
     delete item;
@@ -673,34 +1148,86 @@ void ExprWnd::clearPendingUpdates()
     m_updateStruct.clear();
 }
 
-VarTree* ExprWnd::nextUpdatePtr()
+void ExprWnd::clearPendingValueUpdates()
 {
-    VarTree* ptr = nullptr;
-    if (!m_updatePtrs.empty()) {
-	ptr = m_updatePtrs.front();
-	m_updatePtrs.pop_front();
+    m_updatePtrs.clear();
+    m_updateStruct.clear();
+}
+
+QString ExprWnd::internName(const QString& name)
+{
+    auto it = m_names.constFind(name);
+    if (it != m_names.constEnd())
+	return *it;
+    m_names.insert(name);
+    return name;
+}
+
+bool ExprWnd::isItemInViewport(VarTree* item) const
+{
+    if (!m_visibleItemsKnown) {
+	m_visibleItemsKnown = true;
+	m_visibleItems.clear();
+	QRect r = viewport()->rect();
+	QTreeWidgetItem* last = itemAt(r.bottomLeft());
+	for (QTreeWidgetItem* i = itemAt(r.topLeft()); i; i = itemBelow(i)) {
+	    m_visibleItems.insert(i);
+	    if (i == last)
+		break;
+	}
     }
-    return ptr;
+    return m_visibleItems.contains(item);
 }
 
-VarTree* ExprWnd::nextUpdateType()
+void ExprWnd::paintEvent(QPaintEvent* e)
 {
-    VarTree* ptr = nullptr;
-    if (!m_updateType.empty()) {
-	ptr = m_updateType.front();
-	m_updateType.pop_front();
+    QTreeWidget::paintEvent(e);
+    // the window was scrolled, resized, or changed
+    m_visibleItemsKnown = false;
+}
+
+// the number of pending updates that are checked for visible items
+static const int maxViewportScan = 32;
+
+/*
+ * Removes an item from the list and returns it. Items that the user can
+ * see are taken first, otherwise the items are taken in order. Only the
+ * first few items are checked for visibility, because the list can be
+ * long.
+ */
+VarTree* ExprWnd::takeNextUpdate(std::list<VarTree*>& list) const
+{
+    if (list.empty())
+	return nullptr;
+
+    auto i = list.begin();
+    if (isVisible()) {
+	int n = 0;
+	while (i != list.end() && n < maxViewportScan && !isItemInViewport(*i)) {
+	    ++i;
+	    ++n;
+	}
+	if (i == list.end() || n == maxViewportScan)
+	    i = list.begin();
     }
+    VarTree* ptr = *i;
+    list.erase(i);
     return ptr;
 }
 
+VarTree* ExprWnd::nextUpdatePtr()
+{
+    return takeNextUpdate(m_updatePtrs);
+}
+
+VarTree* ExprWnd::nextUpdateType()
+{
+    return takeNextUpdate(m_updateType);
+}
+
 VarTree* ExprWnd::nextUpdateStruct()
 {
-    VarTree* ptr = nullptr;
-    if (!m_updateStruct.empty()) {
-	ptr = m_updateStruct.front();
-	m_updateStruct.pop_front();
-    }
-    return ptr;
+    return takeNextUpdate(m_updateStruct);
 }
 
 
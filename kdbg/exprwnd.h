@@ -10,7 +10,9 @@
 #include <QTreeWidget>
 #include <QLineEdit>
 #include <QPixmap>
+#include <QSet>
 #include <QStringList>
+#include <QTimer>
 #include <list>
 
 class ProgramTypeTable;
@@ -28,13 +30,19 @@ public:
     VarKind m_varKind;
     enum NameKind { NKplain, NKstatic, NKtype,
 	NKanonymous,			//!< an anonymous struct or union
-	NKaddress			//!< a dereferenced pointer
+	NKaddress,			//!< a dereferenced pointer
+	NKmore				//!< placeholder for elements that gdb did not print
     };
     NameKind m_nameKind;
     const TypeInfo* m_type = {};	//!< the type of struct if it could be derived
     int m_exprIndex;			//!< used in struct value update
     bool m_exprIndexUseGuard;		//!< ditto; if guard expr should be used
     QString m_partialValue;		//!< while struct value update is in progress
+    /**
+     * The elements of a collapsed array; their items are created only
+     * when the array is expanded (see ExprWnd::materializeChildren()).
+     */
+    ExprValue* m_pendingChildren = {};
 
     VarTree(VarTree* parent, ExprValue* v);
     VarTree(ExprWnd* parent, ExprValue* v);
@@ -54,11 +62,22 @@ public:
     const TypeInfo* inferTypeFromBaseClass();
     /** returns whether the pointer is a wchar_t */
     bool isWcharT() const;
+    /** whether expanding this item fetches more elements of the array */
+    bool isArrayContinuation() const;
+    /** the index of the first element that follows this item */
+    int nextArrayIndex() const;
+    /** whether there are children whose items have not been created yet */
+    bool hasPendingChildren() const { return m_pendingChildren != nullptr; }
+    /** the number of children, including those not created yet */
+    int valueChildCount() const;
+    /** grey out the item because it cannot be evaluated in the current scope */
+    void setOutOfScope(bool outOfScope);
+    bool isOutOfScope() const { return m_outOfScope; }
 
     QString getText() const { return text(0); }
     using QTreeWidgetItem::setText;
-    void setText(const QString& t) { QTreeWidgetItem::setText(0, t); }
-    void setPixmap(const QPixmap& p) { QTreeWidgetItem::setIcon(0, QIcon(p)); }
+    void setText(const QString& t);
+    void setIcon(const QIcon& i) { QTreeWidgetItem::setIcon(0, i); }
     QString value() const { return m_baseValue; }
     QString displayedValue() const;
     VarTree* child(int i) const { return static_cast<VarTree*>(QTreeWidgetItem::child(i)); }
@@ -71,6 +90,7 @@ private:
     QString m_structValue;	//!< The "quick member" value
     bool m_baseChanged : 1;
     bool m_structChanged : 1;
+    bool m_outOfScope : 1;
 };
 
 /**
@@ -85,10 +105,15 @@ struct ExprValue
     ExprValue* m_child = {};		/* the first child expression */
     ExprValue* m_next = {};		/* the next sibling expression */
     bool m_initiallyExpanded;
+    bool m_unchanged = false;		/* printed as before; value not parsed */
 
     ExprValue(const QString& name, VarTree::NameKind kind);
     ~ExprValue();
 
+    /** nodes are allocated from a pool, see exprwnd.cpp */
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
     const QString& value() const {
         return m_value;
     }
@@ -134,6 +159,12 @@ public:
     /** updates an existing expression */
     void updateExpr(ExprValue* expr, ProgramTypeTable& typeTable);
     void updateExpr(VarTree* display, ExprValue* newValues, ProgramTypeTable& typeTable);
+    /**
+     * The value of \a display was printed exactly as before. Resets the
+     * marks of changed values and schedules the same updates as
+     * updateExpr() would.
+     */
+    void keepExpr(VarTree* display);
     /** updates the value and repaints it for a single item (not the children) */
     void updateSingleExpr(VarTree* display, ExprValue* newValues);
     /** updates only the value of the node */
@@ -146,9 +177,35 @@ public:
     static VarTree* memberByName(VarTree* v, const QString& name);
     /** removes an expression; must be on the topmost level*/
     void removeExpr(VarTree* item);
+    /** creates the items of the children that were deferred */
+    void materializeChildren(VarTree* display, ProgramTypeTable& typeTable);
+    /**
+     * Inserts the elements of an array slice in place of the continuation
+     * item \a more. The elements begin at index \a start; \a length
+     * elements were requested. \a more is deleted if the end of the array
+     * was reached.
+     */
+    void insertArraySlice(VarTree* more, ExprValue* slice, int start, int length,
+			  ProgramTypeTable& typeTable);
     /** clears the list of pointers needing updates */
     void clearPendingUpdates();
-    /** returns a pointer to update (or 0) and removes it from the list */
+    /**
+     * Forgets the pointers and structs whose values need updates, but
+     * not the structs whose type must be determined. This is sufficient
+     * when all expressions are about to be evaluated again.
+     */
+    void clearPendingValueUpdates();
+    /**
+     * Returns the copy of \a name that the items of this window share.
+     * Member names such as _M_impl or size occur in thousands of items.
+     */
+    QString internName(const QString& name);
+    /** Forgets the shared names, e.g., when the program is unloaded. */
+    void clearNames() { m_names.clear(); }
+    /**
+     * Returns a pointer to update (or 0) and removes it from the list.
+     * Items that are currently scrolled into view come first.
+     */
     VarTree* nextUpdatePtr();
     VarTree* nextUpdateType();
     VarTree* nextUpdateStruct();
@@ -159,20 +216,46 @@ public:
     VarTree* selectedItem() const { return static_cast<VarTree*>(QTreeWidget::currentItem()); }
     VarTree* topLevelItem(int i) const { return static_cast<VarTree*>(QTreeWidget::topLevelItem(i)); }
 
+public Q_SLOTS:
+    /** paints the changes that were deferred by deferRepaint() right away */
+    void flushRepaint();
+
 protected:
     void updateExprRec(VarTree* display, ExprValue* newValues, ProgramTypeTable& typeTable);
+    void keepExprRec(VarTree* display);
     void replaceChildren(VarTree* display, ExprValue* newValues);
+    void updateChildrenByName(VarTree* display, ExprValue* newValues,
+			      ProgramTypeTable& typeTable);
+    void insertChildren(VarTree* display, ExprValue* first);
     void collectUnknownTypes(VarTree* item);
     void checkUnknownType(VarTree* item);
+    bool isItemInViewport(VarTree* item) const;
+    VarTree* takeNextUpdate(std::list<VarTree*>& list) const;
+    void paintEvent(QPaintEvent* e) override;
+    /**
+     * The items that are in view. Asking the view for the geometry of an
+     * item lays out the whole tree if it was changed. Therefore, the items
+     * are determined only once after the window was painted.
+     */
+    mutable QSet<const QTreeWidgetItem*> m_visibleItems;
+    mutable bool m_visibleItemsKnown = false;
     static QString formatWCharPointer(QString value);
-    QPixmap m_pixPointer;
+    QIcon m_iconPointer;		//!< shared by all pointer items
 
     std::list<VarTree*> m_updatePtrs;	//!< dereferenced pointers that need update
     std::list<VarTree*> m_updateType;	//!< structs whose type must be determined
     std::list<VarTree*> m_updateStruct;	//!< structs whose nested value needs update
+    QSet<QString> m_names;		//!< see internName()
 
     ValueEdit* m_edit = {};
 
+    /**
+     * While values arrive one after another, the window is repainted only
+     * when m_repaintTimer expires.
+     */
+    void deferRepaint();
+    QTimer m_repaintTimer;
+
     /** remove items that are in the subTree from the list */
     void unhookSubtree(VarTree* subTree);
     static void unhookSubtree(std::list<VarTree*>& list, VarTree* subTree);
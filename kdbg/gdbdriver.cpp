@@ -8,11 +8,13 @@
 #include "exprwnd.h"
 #include <QFileInfo>
 #include <QRegularExpression>
+#include <QSet>
 #include <klocalizedstring.h>		/* i18n */
 #include <ctype.h>
 #include <signal.h>
 #include <stdlib.h>			/* strtol, atoi */
 #include <string.h>			/* strcpy */
+#include <algorithm>
 
 #include "assert.h"
 #include "mydebug.h"
@@ -121,6 +123,10 @@ static GdbCmdInfo cmds[] = {
     { DCignore, "ignore %d %d\n", GdbCmdInfo::argNum2},
     { DCprintWChar, "print ($s=%s)?*$s@wcslen($s):0x0\n", GdbCmdInfo::argString },
     { DCsetvariable, "set variable %s=%s\n", GdbCmdInfo::argString2 },
+    { DCdefineStruct, "define kdbg__struct%d\n%send\n", GdbCmdInfo::argNumString },
+    { DCprintStructBatch, "kdbg__struct%d %s\n", GdbCmdInfo::argNumString },
+    { DCprintSlice, "print %s\n", GdbCmdInfo::argString },
+    { DCdisassembleFunc, "disassemble %s\n", GdbCmdInfo::argString },
 };
 
 #define NUM_CMDS (int(sizeof(cmds)/sizeof(cmds[0])))
@@ -215,12 +221,12 @@ QString GdbDriver::defaultInvocation() const
     }
 }
 
-bool GdbDriver::startup(QString cmdStr)
-{
-    if (!DebuggerDriver::startup(cmdStr))
-	return false;
+const char GdbDriver::prompt[] = PROMPT;
 
-    static const char gdbInitialize[] =
+/*
+ * These settings are common to all flavors of the gdb driver.
+ */
+const char GdbDriver::gdbSettings[] =
 	/*
 	 * Work around buggy gdbs that do command line editing even if they
 	 * are not on a tty. The readline library echos every command back
@@ -250,6 +256,11 @@ bool GdbDriver::startup(QString cmdStr)
 	 * always succeed.
 	 */
 	"set unwindonsignal on\n"
+	;
+
+QString GdbDriver::initializationCommands() const
+{
+    static const char gdbInitialize[] =
 	/*
 	 * Write a short macro that prints all locals: local variables and
 	 * function arguments.
@@ -264,7 +275,15 @@ bool GdbDriver::startup(QString cmdStr)
 	"set prompt " PROMPT "\n"
 	;
 
-    executeCmdString(DCinitialize, QLatin1String(gdbInitialize), false);
+    return QLatin1String(gdbSettings) + QLatin1String(gdbInitialize);
+}
+
+bool GdbDriver::startup(QString cmdStr)
+{
+    if (!DebuggerDriver::startup(cmdStr))
+	return false;
+
+    executeCmdString(DCinitialize, initializationCommands(), false);
 
     // assume that QString::null is ok
     cmds[DCprintQStringStruct].fmt = printQStringStructFmt;
@@ -282,6 +301,8 @@ void GdbDriver::commandFinished(CmdQueueItem* cmd)
 	return;
     }
 
+    recordResult(cmd);
+
     switch (cmd->m_cmd) {
     case DCinitialize:
 	{
@@ -338,8 +359,42 @@ void GdbDriver::commandFinished(CmdQueueItem* cmd)
     }
 }
 
-int GdbDriver::findPrompt(const QByteArray& output) const
+/*
+ * A command that is pipelined is followed by an echo of a unique mark.
+ * Its output ends with the prompt, the mark, and the prompt of the echo.
+ */
+static QByteArray pipelineMark(unsigned mark)
+{
+    return "kdbg-pipeline-" + QByteArray::number(mark);
+}
+
+QByteArray GdbDriver::encodeCommand(CmdQueueItem* cmd)
+{
+    QByteArray str = DebuggerDriver::encodeCommand(cmd);
+    if (cmd->m_pipelineMark)
+	str += "echo " + pipelineMark(cmd->m_pipelineMark) + "\n";
+    return str;
+}
+
+int GdbDriver::findPrompt(const QByteArray& output, int scanFrom, int& promptEnd) const
 {
+    if (m_activeCmd && m_activeCmd->m_pipelineMark)
+    {
+	/*
+	 * More commands may have been sent after the active one, and
+	 * their output may already follow. A value that looks like the
+	 * prompt must not cut the output short, hence, we look for the
+	 * end with the mark. It may straddle the data that we have seen
+	 * before.
+	 */
+	QByteArray end = PROMPT + pipelineMark(m_activeCmd->m_pipelineMark) + PROMPT;
+	int pos = output.indexOf(end, std::max(scanFrom - end.size() + 1, 0));
+	if (pos < 0)
+	    return -1;
+	promptEnd = pos + end.size();
+	return pos;
+    }
+
     /*
      * If there's a prompt string in the collected output, it must be at
      * the very end.
@@ -355,11 +410,52 @@ int GdbDriver::findPrompt(const QByteArray& output) const
     if (len >= PROMPT_LEN &&
 	strncmp(output.data()+len-PROMPT_LEN, PROMPT, PROMPT_LEN) == 0)
     {
+	promptEnd = len;
 	return len-PROMPT_LEN;
     }
     return -1;
 }
 
+QString GdbDriver::commandName(DbgCommand cmd) const
+{
+    // the first line of the command template, e.g. "print *(%s)"
+    if (cmd < 0 || cmd >= NUM_CMDS)
+	return DebuggerDriver::commandName(cmd);
+    return QString::fromLatin1(cmds[cmd].fmt).section(QLatin1Char('\n'), 0, 0);
+}
+
+bool GdbDriver::canPipeline(const CmdQueueItem* cmd) const
+{
+    if (m_pipelineDepth <= 1)
+	return false;
+
+    /*
+     * Only commands that are not affected by the commands that run
+     * before them, so that they may be queued before those finished.
+     */
+    switch (cmd->m_cmd) {
+    case DCinfolocals:
+    case DCinforegisters:
+    case DCexamine:
+    case DCbt:
+    case DCprint:
+    case DCprintDeref:
+    case DCprintStruct:
+    case DCprintQStringStruct:
+    case DCprintWChar:
+    case DCprintStructBatch:
+    case DCprintSlice:
+    case DCdisassembleFunc:
+    case DCfindType:
+    case DCinfosharedlib:
+    case DCinfothreads:
+    case DCinfobreak:
+	return true;
+    default:
+	return false;
+    }
+}
+
 /*
  * The --fullname option makes gdb send a special normalized sequence print
  * each time the program stops and at some other points. The sequence has
@@ -449,12 +545,25 @@ QString GdbDriver::makeCmdString(DbgCommand cmd, int intArg)
 
 QString GdbDriver::makeCmdString(DbgCommand cmd, QString strArg, int intArg1, int intArg2)
 {
-    assert(cmd == DCexamine);
+    assert(cmd == DCexamine || cmd == DCprintSlice);
 
     normalizeStringArg(strArg);
 
     QString cmdString;
 
+    if (cmd == DCprintSlice) {
+	/*
+	 * Print intArg2 elements of array strArg, beginning at index
+	 * intArg1, but do not run past the end of the array.
+	 */
+	QString size = QStringLiteral("sizeof(%1)/sizeof((%1)[0])").arg(strArg);
+	QString count = QStringLiteral("(%1-%2<%3?%1-%2:%3)").arg(size,
+				QString::number(intArg1), QString::number(intArg2));
+	QString slice = QStringLiteral("(%1)[%2]@%3").arg(strArg,
+				QString::number(intArg1), count);
+	cmdString = QString::asprintf(cmds[cmd].fmt, slice.toUtf8().constData());
+    }
+
     if (cmd == DCexamine) {
 	// make a format specifier from the intArg
 	static const char size[16] = {
@@ -518,6 +627,22 @@ QString GdbDriver::makeCmdString(DbgCommand cmd, QString strArg, int intArg)
 	return makeCmdString(DCtty, strArg);   /* note: no problem if strArg empty */
     }
 
+    if (cmd == DCdefineStruct)
+    {
+	/*
+	 * strArg lists the expressions, one per line, where %s stands for
+	 * the struct, which is the argument of the defined command. Each
+	 * value is introduced by \032 so that the output can be split up.
+	 */
+	QString body;
+	const QStringList exprs = strArg.split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+	for (QString expr : exprs) {
+	    expr.replace(QStringLiteral("%s"), QStringLiteral("$arg0"));
+	    body += QStringLiteral("echo \\032\noutput ") + expr + QLatin1Char('\n');
+	}
+	strArg = body;
+    }
+
     if (cmds[cmd].argsNeeded == GdbCmdInfo::argStringNum)
     {
 	// line numbers are zero-based
@@ -625,12 +750,10 @@ static void skipDecimal(const char*& p)
  * If there are warnings, they are skipped and output points past the warnings
  * on return (even if there \e are errors).
  */
-static bool parseErrorMessage(const char*& output,
-			      ExprValue*& variable, bool wantErrorValue)
+static void skipWarnings(const char*& output)
 {
     skipSpace(output);
 
-    // skip warnings
     while (strncmp(output, "warning:", 8) == 0)
     {
 	const char* end = strchr(output+8, '\n');
@@ -640,6 +763,12 @@ static bool parseErrorMessage(const char*& output,
 	    output = end+1;
         skipSpace(output);
     }
+}
+
+static bool parseErrorMessage(const char*& output,
+			      ExprValue*& variable, bool wantErrorValue)
+{
+    skipWarnings(output);
 
     if (isErrorExpr(output))
     {
@@ -890,14 +1019,15 @@ static void skipNested(const char*& s, char opening, char closing)
     p++;
     /*
      * Search for next matching `closing' char, skipping nested pairs of
-     * `opening' and `closing'.
+     * `opening' and `closing'. strcspn() jumps over the uninteresting
+     * text much faster than a loop over the characters.
      */
-    while (*p && nest > 0) {
-	if (*p == opening) {
-	    nest++;
-	} else if (*p == closing) {
-	    nest--;
-	}
+    const char delims[] = { opening, closing, '\0' };
+    while (nest > 0) {
+	p += strcspn(p, delims);
+	if (*p == '\0')
+	    break;
+	nest += *p == opening ? 1 : -1;
 	p++;
     }
     if (nest != 0) {
@@ -965,13 +1095,11 @@ static void skipNestedAngles(const char*& s)
 static void findEnd(const char*& s)
 {
     const char* p = s;
-    while (*p && *p!='\n') {
-	while (*p && *p!='\n' && *p!='{')
-	    p++;
-	if (*p=='{') {
-	    p++;
-	    skipNested(p, '{', '}'); p--;
-	}
+    for (;;) {
+	p += strcspn(p, "\n{");
+	if (*p != '{')
+	    break;
+	skipNested(p, '{', '}');
     }
     s = p;
 }
@@ -995,17 +1123,20 @@ static void skipString(const char*& p)
 moreStrings:
     // opening quote
     char quote = *p++;
-    while (*p != quote) {
-	if (*p == '\\') {
-	    // skip escaped character
-	    // no special treatment for octal values necessary
-	    p++;
-	}
-	// simply return if no more characters
-	if (*p == '\0')
+    const char stop[] = { quote, '\\', '\0' };
+    for (;;) {
+	p += strcspn(p, stop);
+	if (*p != '\\')
+	    break;
+	// skip escaped character
+	// no special treatment for octal values necessary
+	if (*++p == '\0')
 	    return;
 	p++;
     }
+    // simply return if no more characters
+    if (*p == '\0')
+	return;
     // closing quote
     p++;
     /*
@@ -1082,14 +1213,18 @@ static void skipNestedWithString(const char*& s, char opening, char closing)
      * Search for next matching `closing' char, skipping nested pairs of
      * `opening' and `closing' as well as strings.
      */
-    while (*p && nest > 0) {
+    const char delims[] = { opening, closing, '\'', '"', '\0' };
+    while (nest > 0) {
+	p += strcspn(p, delims);
 	if (*p == opening) {
 	    nest++;
 	} else if (*p == closing) {
 	    nest--;
-	} else if (*p == '\'' || *p == '\"') {
+	} else if (*p == '\'' || *p == '"') {
 	    skipString(p);
 	    continue;
+	} else {
+	    break;			/* end of text */
 	}
 	p++;
     }
@@ -1507,10 +1642,24 @@ static bool parseNested(const char*& s, ExprValue* variable)
     return true;
 }
 
+/**
+ * Returns the link where the next child of variable must be stored.
+ * The sequence parsers append children through this link so that long
+ * arrays do not walk the list of children for every element.
+ */
+static ExprValue** lastChildLink(ExprValue* variable)
+{
+    ExprValue** tail = &variable->m_child;
+    while (*tail)
+	tail = &(*tail)->m_next;
+    return tail;
+}
+
 static bool parseVarSeq(const char*& s, ExprValue* variable)
 {
     // parse a comma-separated sequence of variables
     ExprValue* var = variable;		/* var != nullptr to indicate success if empty seq */
+    ExprValue** tail = lastChildLink(variable);
     for (;;) {
 	if (*s == '}')
 	    break;
@@ -1523,7 +1672,8 @@ static bool parseVarSeq(const char*& s, ExprValue* variable)
 	var = parseVar(s);
 	if (!var)
 	    break;			/* syntax error */
-	variable->appendChild(var);
+	*tail = var;
+	tail = &var->m_next;
 	if (*s != ',')
 	    break;
 	// skip the comma and whitespace
@@ -1538,8 +1688,9 @@ static bool parseValueSeq(const char*& s, ExprValue* variable)
     // parse a comma-separated sequence of variables
     int index = 0;
     bool good;
+    ExprValue** tail = lastChildLink(variable);
     for (;;) {
-	QString name = QString::asprintf("[%d]", index);
+	QString name = QLatin1Char('[') + QString::number(index) + QLatin1Char(']');
 	ExprValue* var = new ExprValue(name, VarTree::NKplain);
 	good = parseValue(s, var);
 	if (!good) {
@@ -1568,13 +1719,14 @@ static bool parseValueSeq(const char*& s, ExprValue* variable)
 	} else {
 	    index++;
 	}
-	variable->appendChild(var);
+	*tail = var;
+	tail = &var->m_next;
 	// long arrays may be terminated by '...'
 	if (strncmp(s, "...", 3) == 0) {
 	    s += 3;
-	    ExprValue* var = new ExprValue(QStringLiteral("..."), VarTree::NKplain);
+	    ExprValue* var = new ExprValue(QStringLiteral("..."), VarTree::NKmore);
 	    var->m_value = i18n("<additional entries of the array suppressed>");
-	    variable->appendChild(var);
+	    *tail = var;
 	    break;
 	}
 	if (*s != ',') {
@@ -1591,10 +1743,12 @@ static bool parseValueSeq(const char*& s, ExprValue* variable)
 }
 
 /**
- * Parses a stack frame.
+ * Parses a stack frame. func receives the text that describes the frame;
+ * name, if non-zero, receives only the name of the function.
  */
 static void parseFrameInfo(const char*& s, QString& func,
-			   QString& file, int& lineNo, DbgAddr& address)
+			   QString& file, int& lineNo, DbgAddr& address,
+			   QString* name = nullptr)
 {
     const char* p = s;
 
@@ -1616,6 +1770,8 @@ static void parseFrameInfo(const char*& s, QString& func,
     // check for special signal handler frame
     if (strncmp(p, "<signal handler called>", 23) == 0) {
 	func = QString::fromLatin1(start, 23);
+	if (name)
+	    *name = func;
 	file = QString();
 	lineNo = -1;
 	s = p+23;
@@ -1658,6 +1814,10 @@ static void parseFrameInfo(const char*& s, QString& func,
 	    p++;
 	}
     }
+    if (name) {
+	// without the blank before the parameter list
+	*name = QString::fromLatin1(start, p-start).trimmed();
+    }
 
     if (*p == '\0') {
 	func = QLatin1String(start);
@@ -1754,7 +1914,8 @@ static void parseFrameInfo(const char*& s, QString& func,
  * Parses a stack frame including its frame number
  */
 static bool parseFrame(const char*& s, int& frameNo, QString& func,
-		       QString& file, int& lineNo, DbgAddr& address)
+		       QString& file, int& lineNo, DbgAddr& address,
+		       QString* name = nullptr)
 {
     // Example:
     //  #1  0x8048881 in Dl::Dl (this=0xbffff418, r=3214) at testfile.cpp:72
@@ -1779,23 +1940,24 @@ static bool parseFrame(const char*& s, int& frameNo, QString& func,
     // space and comma
     while (isspace(*s) || *s == ',')
 	s++;
-    parseFrameInfo(s, func, file, lineNo, address);
+    parseFrameInfo(s, func, file, lineNo, address, name);
     return true;
 }
 
 void GdbDriver::parseBackTrace(const char* output, std::list<StackFrame>& stack)
 {
-    QString func, file;
+    QString func, file, name;
     int lineNo, frameNo;
     DbgAddr address;
 
-    while (::parseFrame(output, frameNo, func, file, lineNo, address)) {
+    while (::parseFrame(output, frameNo, func, file, lineNo, address, &name)) {
 	stack.push_back(StackFrame());
 	StackFrame* frm = &stack.back();
 	frm->frameNo = frameNo;
 	frm->fileName = file;
 	frm->lineNo = lineNo;
 	frm->address = address;
+	frm->function = name;
 	frm->var = new ExprValue(func, VarTree::NKplain);
     }
 }
@@ -2154,14 +2316,51 @@ static bool parseNewWatchpoint(const char* o, int& id,
     return true;
 }
 
-void GdbDriver::parseLocals(const char* output, std::list<ExprValue*>& newVars)
+/*
+ * Finds the end of a variable in the output of "info locals" without
+ * parsing the value. Returns false if the variable must be parsed.
+ */
+static bool skipLocal(const char*& s, QString& name, VarTree::NameKind& kind)
+{
+    const char* p = s;
+    if (*p == '{' || !parseName(p, name, kind))
+	return false;
+    skipSpace(p);
+    if (*p != '=')
+	return false;
+    p++;
+    skipSpace(p);
+    // a warning takes a line of its own
+    if (strncmp(p, "warning: ", 9) == 0)
+	return false;
+
+    // the value ends at the end of the line that is not inside braces
+    for (;;) {
+	p += strcspn(p, "\n{\"'");
+	if (*p == '{')
+	    skipNestedWithString(p, '{', '}');
+	else if (*p == '"' || *p == '\'')
+	    skipString(p);
+	else
+	    break;
+    }
+    s = p;
+    return true;
+}
+
+void GdbDriver::parseLocals(const char* output, std::list<ExprValue*>& newVars,
+			    QHash<QString,QByteArray>& printed)
 {
+    QHash<QString,QByteArray> oldPrints;
+    oldPrints.swap(printed);
+
     // check for possible error conditions
     if (strncmp(output, "No symbol table", 15) == 0)
     {
 	return;
     }
 
+    QSet<QString> seen;
     while (*output != '\0') {
 	skipSpace(output);
 	if (*output == '\0')
@@ -2177,19 +2376,42 @@ void GdbDriver::parseLocals(const char* output, std::list<ExprValue*>& newVars)
 	    continue;
 	}
 
+	/*
+	 * A variable whose text is the same as at the last stop is not
+	 * parsed again.
+	 */
+	QString name;
+	VarTree::NameKind kind;
+	const char* end = output;
+	if (skipLocal(end, name, kind)) {
+	    if (seen.contains(name)) {
+		output = end;		/* do not add duplicates */
+		continue;
+	    }
+	    QByteArray print(output, end - output);
+	    printed.insert(name, print);
+	    auto o = oldPrints.constFind(name);
+	    if (o != oldPrints.constEnd() && *o == print) {
+		ExprValue* variable = new ExprValue(name, kind);
+		variable->m_unchanged = true;
+		seen.insert(name);
+		newVars.push_back(variable);
+		output = end;
+		continue;
+	    }
+	}
+
 	ExprValue* variable = parseVar(output);
 	if (!variable) {
 	    break;
 	}
 	// do not add duplicates
-	for (std::list<ExprValue*>::iterator o = newVars.begin(); o != newVars.end(); ++o) {
-	    if ((*o)->m_name == variable->m_name) {
-		delete variable;
-		goto skipDuplicate;
-	    }
+	if (seen.contains(variable->m_name)) {
+	    delete variable;
+	    continue;
 	}
+	seen.insert(variable->m_name);
 	newVars.push_back(variable);
-    skipDuplicate:;
     }
 }
 
@@ -2205,6 +2427,19 @@ ExprValue* GdbDriver::parsePrintExpr(const char* output, bool wantErrorValue)
     return var;
 }
 
+QString GdbDriver::parseMissingSymbol(const char* output)
+{
+    // No symbol "foo" in current context.
+    skipWarnings(output);
+    if (strncmp(output, "No symbol \"", 11) != 0)
+	return QString();
+    const char* start = output + 11;
+    const char* end = strchr(start, '"');
+    if (!end || strncmp(end, "\" in current context.", 21) != 0)
+	return QString();
+    return QString::fromLatin1(start, end-start);
+}
+
 bool GdbDriver::parseChangeWD(const char* output, QString& message)
 {
     bool isGood = false;
@@ -2376,6 +2611,39 @@ QStringList GdbDriver::parseSharedLibs(const char* output)
     return shlibs;
 }
 
+bool GdbDriver::canBatchStructExprs() const
+{
+    return true;
+}
+
+void GdbDriver::parseStructBatch(const char* output, std::list<ExprValue*>& values)
+{
+    /*
+     * Each value is introduced by \032 (see DCdefineStruct). An error
+     * aborts the user-defined command.
+     */
+    const char* p = strchr(output, '\032');
+    while (p)
+    {
+	p++;
+	const char* end = strchr(p, '\032');
+	QByteArray part = end ? QByteArray(p, end-p) : QByteArray(p);
+	const char* s = part.constData();
+	ExprValue* var = nullptr;
+	if (parseErrorMessage(s, var, false)) {
+	    values.push_back(nullptr);
+	    return;
+	}
+	var = new ExprValue(QString(), VarTree::NKplain);
+	if (!parseValue(s, var)) {
+	    delete var;
+	    var = nullptr;
+	}
+	values.push_back(var);
+	p = end;
+    }
+}
+
 bool GdbDriver::parseFindType(const char* output, QString& type)
 {
     if (strncmp(output, "type = ", 7) != 0)
@@ -2633,6 +2901,12 @@ std::list<DisassembledCode> GdbDriver::parseDisassemble(const char* output)
 		break;
 	}
 	const char* start = p;
+	// functions in several pieces have a header for each piece
+	if (strncmp(p, "Address range", 13) == 0) {
+	    while (p != end && *p++ != '\n')
+		;
+	    continue;
+	}
 	// address
 	while (p != end && !isspace(*p))
 	    p++;
@@ -23,6 +23,7 @@ public:
     static QString defaultGdb();
     bool startup(QString cmdStr) override;
     void commandFinished(CmdQueueItem* cmd) override;
+    QString commandName(DbgCommand cmd) const override;
 
     void terminate() override;
     void detachAndTerminate() override;
@@ -36,14 +37,18 @@ public:
     std::list<ThreadInfo> parseThreadList(const char* output) override;
     bool parseBreakpoint(const char* output, int& id,
 				 QString& file, int& lineNo, QString& address) override;
-    void parseLocals(const char* output, std::list<ExprValue*>& newVars) override;
+    void parseLocals(const char* output, std::list<ExprValue*>& newVars,
+		     QHash<QString,QByteArray>& printed) override;
     ExprValue* parsePrintExpr(const char* output, bool wantErrorValue) override;
+    QString parseMissingSymbol(const char* output) override;
     bool parseChangeWD(const char* output, QString& message) override;
     bool parseChangeExecutable(const char* output, QString& message) override;
     bool parseCoreFile(const char* output) override;
     uint parseProgramStopped(const char* output, bool haveCoreFile,
 				     QString& message) override;
     QStringList parseSharedLibs(const char* output) override;
+    bool canBatchStructExprs() const override;
+    void parseStructBatch(const char* output, std::list<ExprValue*>& values) override;
     bool parseFindType(const char* output, QString& type) override;
     std::list<RegisterInfo> parseRegisters(const char* output) override;
     bool parseInfoLine(const char* output,
@@ -59,6 +64,13 @@ protected:
     QString m_redirect;			/* redirection to /dev/null */
     bool m_littleendian = true;		/* if gdb works with little endian or big endian */
     QString m_defaultCmd;		/* how to invoke gdb */
+    static const char gdbSettings[];	/* settings common to all gdb flavors */
+    static const char prompt[];		/* the prompt that gdb is told to use */
+
+    /**
+     * Returns the commands that are sent to gdb right after it started.
+     */
+    virtual QString initializationCommands() const;
 
     QString makeCmdString(DbgCommand cmd) override;
     QString makeCmdString(DbgCommand cmd, QString strArg) override;
@@ -67,7 +79,9 @@ protected:
     QString makeCmdString(DbgCommand cmd, QString strArg1, QString strArg2) override;
     QString makeCmdString(DbgCommand cmd, int intArg1, int intArg2) override;
     QString makeCmdString(DbgCommand cmd, QString strArg, int intArg1, int intArg2) override;
-    int findPrompt(const QByteArray& output) const override;
+    QByteArray encodeCommand(CmdQueueItem* cmd) override;
+    int findPrompt(const QByteArray& output, int scanFrom, int& promptEnd) const override;
+    bool canPipeline(const CmdQueueItem* cmd) const override;
     void parseMarker(CmdQueueItem* cmd);
 };
 
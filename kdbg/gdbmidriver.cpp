@@ -0,0 +1,352 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "gdbmidriver.h"
+#include <QRegularExpression>
+#include <ctype.h>
+#include <string.h>
+
+#include "mydebug.h"
+
+
+GdbMiDriver::GdbMiDriver() :
+	GdbDriver()
+{
+}
+
+GdbMiDriver::~GdbMiDriver()
+{
+}
+
+
+QString GdbMiDriver::driverName() const
+{
+    return QStringLiteral("GDBMI");
+}
+
+QString GdbMiDriver::defaultGdbMi()
+{
+    return QStringLiteral(
+	"gdb"
+	" --interpreter=mi"	/* talk GDB/MI, the latest version gdb knows */
+	" --nx"		/* do not execute initialization files */
+    );
+}
+
+QString GdbMiDriver::defaultInvocation() const
+{
+    if (m_defaultCmd.isEmpty()) {
+	return defaultGdbMi();
+    } else {
+	return m_defaultCmd;
+    }
+}
+
+bool GdbMiDriver::startup(QString cmdStr)
+{
+    if (cmdStr.isEmpty())
+	cmdStr = defaultInvocation();
+
+    // the global debugger command is usually meant for the CLI driver
+    if (!cmdStr.contains(QLatin1String("--interpreter")))
+	cmdStr += QLatin1String(" --interpreter=mi");
+
+    m_lastToken = 0;
+    return GdbDriver::startup(cmdStr);
+}
+
+QString GdbMiDriver::initializationCommands() const
+{
+    /*
+     * There is no need for a special prompt, and user-defined commands
+     * cannot be defined via -interpreter-exec.
+     */
+    return QLatin1String(gdbSettings) + QLatin1String("show endian\n");
+}
+
+QString GdbMiDriver::makeCmdString(DbgCommand cmd)
+{
+    if (cmd == DCinfolocals) {
+	// local vars supersede args with same name, see kdbg__alllocals
+	return QStringLiteral("info locals\ninfo args\n");
+    }
+    return GdbDriver::makeCmdString(cmd);
+}
+
+/*
+ * Each line of the command string becomes one argument of
+ * -interpreter-exec, which runs them in order and answers with a single
+ * result record.
+ */
+QByteArray GdbMiDriver::encodeCommand(CmdQueueItem* cmd)
+{
+    QByteArray str = QByteArray::number(++m_lastToken);
+    str += "-interpreter-exec console";
+
+    const QByteArray cmdStr = cmd->m_cmdString.toLocal8Bit();
+    for (const QByteArray& line : cmdStr.split('\n'))
+    {
+	if (line.isEmpty())
+	    continue;
+	str += " \"";
+	for (char c : line) {
+	    if (c == '"' || c == '\\')
+		str += '\\';
+	    str += c;
+	}
+	str += '"';
+    }
+    str += '\n';
+    return str;
+}
+
+/*
+ * Parses an MI c-string that starts at the opening quote and returns its
+ * contents unescaped. p is advanced past the closing quote.
+ */
+static QByteArray parseCString(const char*& p, const char* end)
+{
+    QByteArray result;
+    if (p >= end || *p != '"')
+	return result;
+    p++;
+    while (p < end && *p != '"')
+    {
+	if (*p != '\\' || p+1 >= end) {
+	    result += *p++;
+	    continue;
+	}
+	p++;				/* skip backslash */
+	switch (*p) {
+	case 'n': result += '\n'; p++; break;
+	case 't': result += '\t'; p++; break;
+	case 'r': result += '\r'; p++; break;
+	case 'f': result += '\f'; p++; break;
+	case 'v': result += '\v'; p++; break;
+	case 'a': result += '\a'; p++; break;
+	case 'b': result += '\b'; p++; break;
+	case 'e': result += '\033'; p++; break;
+	default:
+	    if (*p >= '0' && *p <= '7') {
+		// octal escape
+		int c = 0;
+		for (int i = 0; i < 3 && p < end && *p >= '0' && *p <= '7'; i++)
+		    c = c*8 + *p++ - '0';
+		result += char(c);
+	    } else {
+		result += *p++;
+	    }
+	}
+    }
+    if (p < end)
+	p++;				/* skip closing quote */
+    return result;
+}
+
+/*
+ * Returns the value of the c-string field with the given name, which must
+ * include the leading separator and trailing '=', e.g. ",line=".
+ */
+static QByteArray fieldValue(const char* start, const char* end, const char* name)
+{
+    QByteArray rec = QByteArray::fromRawData(start, end-start);
+    int pos = rec.indexOf(name);
+    if (pos < 0)
+	return QByteArray();
+    const char* p = start + pos + strlen(name);
+    return parseCString(p, end);
+}
+
+static bool isPromptLine(const char* p, const char* eol)
+{
+    return eol-p >= 5 && strncmp(p, "(gdb)", 5) == 0;
+}
+
+/*
+ * Skips the token that prefixes a result record and returns it, or 0 if
+ * there is none.
+ */
+static unsigned skipToken(const char*& p, const char* eol)
+{
+    unsigned token = 0;
+    while (p < eol && isdigit(*p))
+	token = token*10 + *p++ - '0';
+    return token;
+}
+
+bool GdbMiDriver::canPipeline(const CmdQueueItem*) const
+{
+    // the tokens would allow it, but findPrompt() expects only one command
+    return false;
+}
+
+int GdbMiDriver::findPrompt(const QByteArray& output, int scanFrom, int& promptEnd) const
+{
+    /*
+     * The command is complete when we have seen its result record
+     * (except ^running, in which case we wait for the program to stop)
+     * followed by the (gdb) prompt. An interrupted command may have been
+     * sent with an older token.
+     *
+     * The complete lines before scanFrom were inspected by an earlier
+     * call; only the last incomplete line is looked at again.
+     */
+    const char* start = output.constData();
+    const char* end = start + output.size();
+    const char* p = start;
+    if (scanFrom <= 0) {
+	m_resultSeen = false;
+    } else {
+	p = start + scanFrom;
+	while (p > start && p[-1] != '\n')
+	    --p;
+    }
+    bool& complete = m_resultSeen;
+    while (p < end)
+    {
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end-p));
+	if (!eol)
+	    break;			/* line is incomplete */
+
+	if (isPromptLine(p, eol)) {
+	    if (complete) {
+		promptEnd = eol+1 - start;
+		return p - start;
+	    }
+	} else if (strncmp(p, "*stopped", 8) == 0) {
+	    complete = true;
+	} else {
+	    const char* r = p;
+	    unsigned token = skipToken(r, eol);
+	    if (r < eol && *r == '^' &&
+		(token == m_lastToken || m_state == DSinterrupted))
+	    {
+		if (strncmp(r, "^exit", 5) == 0) {
+		    promptEnd = eol+1 - start;	/* no prompt follows */
+		    return promptEnd;
+		}
+		if (strncmp(r, "^running", 8) != 0)
+		    complete = true;
+	    }
+	}
+	p = eol+1;
+    }
+    return -1;
+}
+
+QByteArray GdbMiDriver::cookOutput(const QByteArray& output, DbgCommand cmd)
+{
+    QByteArray cooked;
+    QByteArray fullname, line, addr;	/* from the last frame tuple */
+    m_breakListChanged = false;
+
+    const char* end = output.constData() + output.size();
+    for (const char* p = output.constData(); p < end;)
+    {
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end-p));
+	if (!eol)
+	    eol = end;
+	const char* next = eol < end ? eol+1 : end;
+	if (eol > p && eol[-1] == '\r')
+	    --eol;
+
+	const char* r = p;
+	skipToken(r, eol);
+	switch (r < eol ? *r : '\0') {
+	case '~':			/* console stream */
+	case '@':			/* target stream */
+	    r++;
+	    cooked += parseCString(r, eol);
+	    break;
+	case '&':			/* log stream: echos and duplicate errors */
+	    break;
+	case '^':
+	    if (strncmp(r, "^error", 6) == 0) {
+		QByteArray msg = fieldValue(r, eol, ",msg=");
+		cooked += msg;
+		if (!msg.endsWith('\n'))
+		    cooked += '\n';
+	    }
+	    break;
+	case '*':
+	case '=':
+	    if (strncmp(r, "=breakpoint-", 12) == 0) {
+		m_breakListChanged = true;
+	    } else if (strncmp(r, "*stopped", 8) == 0 ||
+		       strncmp(r, "=thread-selected", 16) == 0)
+	    {
+		const char* frame = strstr(r, "frame={");
+		if (frame && frame < eol) {
+		    QByteArray f = fieldValue(frame, eol, ",fullname=");
+		    if (!f.isEmpty()) {
+			fullname = f;
+			line = fieldValue(frame, eol, ",line=");
+			addr = fieldValue(frame, eol, "addr=");
+		    }
+		}
+	    }
+	    break;
+	case '(':
+	    if (isPromptLine(r, eol))
+		break;
+	    // fall through
+	default:
+	    // not an MI record, e.g. output of the program
+	    cooked.append(p, next-p);
+	}
+	p = next;
+    }
+
+    /*
+     * Provide the source position in the format of gdb's --fullname
+     * option so that GdbDriver::parseMarker() can find it.
+     */
+    if (!cooked.contains("\032\032"))
+    {
+	if (fullname.isEmpty() && (cmd == DCinfolinemain || cmd == DCinfoline))
+	{
+	    // Line 5 of "t.c" starts at address 0x1139 <main+4> and ends at ...
+	    static QRegularExpression lineRE(QStringLiteral(
+		"Line (\\d+) of \"([^\"]+)\"\\s+(?:starts at|is at) address (0x[0-9a-fA-F]+)"));
+	    auto res = lineRE.match(QString::fromLocal8Bit(cooked));
+	    if (res.hasMatch()) {
+		line = res.captured(1).toLatin1();
+		fullname = res.captured(2).toLocal8Bit();
+		addr = res.captured(3).toLatin1();
+	    }
+	}
+	if (!fullname.isEmpty() && !line.isEmpty() && addr.startsWith("0x")) {
+	    cooked += "\032\032" + fullname + ':' + line + ":0:beg:" + addr + '\n';
+	}
+    }
+    return cooked;
+}
+
+void GdbMiDriver::commandFinished(CmdQueueItem* cmd)
+{
+    m_output = cookOutput(m_output, cmd->m_cmd);
+    TRACE("cooked MI output: " + QString::fromLocal8Bit(m_output));
+    GdbDriver::commandFinished(cmd);
+}
+
+bool GdbMiDriver::canBatchStructExprs() const
+{
+    // the command cannot be defined via -interpreter-exec
+    return false;
+}
+
+uint GdbMiDriver::parseProgramStopped(const char* output, bool haveCoreFile,
+				      QString& message)
+{
+    uint flags = GdbDriver::parseProgramStopped(output, haveCoreFile, message);
+    /*
+     * Hit counts and temporary breakpoints that were removed are
+     * announced by asynchronous notifications.
+     */
+    if (m_breakListChanged)
+	flags |= SFrefreshBreak;
+    return flags;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef GDBMIDRIVER_H
+#define GDBMIDRIVER_H
+
+#include "gdbdriver.h"
+
+
+/**
+ * This driver talks to gdb using its machine interface (GDB/MI).
+ *
+ * Every command is sent as a tokenized -interpreter-exec console request,
+ * and the end of its output is recognized by the result record that
+ * carries the same token (or, for commands that run the program, by the
+ * *stopped record), not by scraping a prompt string. The console stream
+ * records are unescaped and handed to the parsers of GdbDriver, so that
+ * both drivers understand the values that gdb prints in the same way.
+ * Source positions are taken from the frame tuples of the asynchronous
+ * records instead of the annotations of gdb's --fullname option.
+ */
+class GdbMiDriver : public GdbDriver
+{
+    Q_OBJECT
+public:
+    GdbMiDriver();
+    ~GdbMiDriver();
+
+    QString driverName() const override;
+    QString defaultInvocation() const override;
+    static QString defaultGdbMi();
+    bool startup(QString cmdStr) override;
+    void commandFinished(CmdQueueItem* cmd) override;
+    uint parseProgramStopped(const char* output, bool haveCoreFile,
+			     QString& message) override;
+    bool canBatchStructExprs() const override;
+
+protected:
+    unsigned m_lastToken = 0;		/* token of the last command sent */
+    bool m_breakListChanged = false;	/* =breakpoint-* seen in last output */
+    mutable bool m_resultSeen = false;	/* findPrompt() saw the result record */
+
+    QString initializationCommands() const override;
+    QString makeCmdString(DbgCommand cmd) override;
+    using GdbDriver::makeCmdString;
+    QByteArray encodeCommand(CmdQueueItem* cmd) override;
+    int findPrompt(const QByteArray& output, int scanFrom, int& promptEnd) const override;
+    bool canPipeline(const CmdQueueItem* cmd) const override;
+    /**
+     * Converts the MI records in \a output to the text that gdb's
+     * command line interface would have printed.
+     */
+    QByteArray cookOutput(const QByteArray& output, DbgCommand cmd);
+};
+
+#endif // GDBMIDRIVER_H
@@ -59,8 +59,10 @@ int main(int argc, char** argv)
 	parser.addOption(QCommandLineOption(QStringList() << QLatin1String(opt), desc, QLatin1String(arg)));
     };
     opt("t", i18n("transcript of conversation with the debugger"), "file");
+    opt("T", i18n("record the session with the debugger for --replay"), "file");
+    opt("replay", i18n("replay a recorded session instead of running the debugger"), "file");
     opt("r", i18n("remote debugging via <device>"), "device");
-    opt("l", i18n("specify language: C"), "language");
+    opt("l", i18n("specify language: C, or driver: GDB, GDBMI"), "language");
     opt("a", i18n("specify arguments of debugged executable"), "args");
     opt("p", i18n("specify PID of process to debug"), "pid");
     parser.addPositionalArgument(QLatin1String("[program]"), i18n("path of executable to debug"));
@@ -102,6 +104,8 @@ int main(int argc, char** argv)
 	transcript = qEnvironmentVariable("KDBG_TRANSCRIPT");
     }
     debugger->setTranscript(transcript);
+    debugger->setRecordFile(parser.value(QStringLiteral("T")));
+    debugger->setReplayFile(parser.value(QStringLiteral("replay")));
 
     QString pid = parser.value(QStringLiteral("p"));
     QString programArgs = parser.value(QStringLiteral("a"));
@@ -0,0 +1,129 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "replaydriver.h"
+#include <algorithm>
+#include <iterator>
+#include "mydebug.h"
+
+
+ReplayDriver::ReplayDriver(const QString& fileName) :
+	GdbDriver(),
+	m_fileName(fileName)
+{
+}
+
+ReplayDriver::~ReplayDriver()
+{
+}
+
+bool ReplayDriver::startup(QString)
+{
+    std::vector<TranscriptRecord> records;
+    if (!readTranscript(m_fileName, records)) {
+	TRACE("cannot read recorded session " + m_fileName);
+	return false;
+    }
+    m_results.clear();
+    std::copy_if(records.begin(), records.end(), std::back_inserter(m_results),
+		 [](const TranscriptRecord& r) {
+		     return r.type == TranscriptRecord::RTresult;
+		 });
+    m_used.assign(m_results.size(), false);
+    m_cursor = 0;
+
+    // a process that swallows the commands
+    setStandardOutputFile(QProcess::nullDevice());
+    return GdbDriver::startup(QStringLiteral("cat"));
+}
+
+void ReplayDriver::terminate()
+{
+    // there is no gdb that could be interrupted
+    flushCommands();
+    closeWriteChannel();
+}
+
+void ReplayDriver::detachAndTerminate()
+{
+    terminate();
+}
+
+void ReplayDriver::interruptInferior()
+{
+    flushHiPriQueue();
+}
+
+bool ReplayDriver::canPipeline(const CmdQueueItem*) const
+{
+    // the output is provided one command at a time
+    return false;
+}
+
+/*
+ * The names of terminals, files, processes etc. in these commands differ
+ * between sessions, but the output is still the one for the command.
+ */
+static bool textMayDiffer(DbgCommand cmd)
+{
+    switch (cmd) {
+    case DCinitialize:
+    case DCtty:
+    case DCexecutable:
+    case DCcorefile:
+    case DCattach:
+	return true;
+    default:
+	return false;
+    }
+}
+
+const QByteArray* ReplayDriver::findResult(const CmdQueueItem* cmd)
+{
+    QByteArray str = cmd->m_cmdString.toUtf8();
+    size_t found = m_results.size();
+    for (size_t i = m_cursor; i < m_results.size(); i++) {
+	if (!m_used[i] && m_results[i].cmd == cmd->m_cmd &&
+	    m_results[i].command == str)
+	{
+	    found = i;
+	    break;
+	}
+    }
+    if (found == m_results.size() && textMayDiffer(cmd->m_cmd)) {
+	for (size_t i = m_cursor; i < m_results.size(); i++) {
+	    if (!m_used[i] && m_results[i].cmd == cmd->m_cmd) {
+		found = i;
+		break;
+	    }
+	}
+    }
+    if (found == m_results.size()) {
+	// the output for another expression or location would be wrong
+	TRACE("no recorded output for " + cmd->m_cmdString);
+	return nullptr;
+    }
+
+    m_used[found] = true;
+    while (m_cursor < m_used.size() && m_used[m_cursor])
+	m_cursor++;
+    return &m_results[found].payload;
+}
+
+void ReplayDriver::slotCommandRead()
+{
+    GdbDriver::slotCommandRead();
+
+    if (!m_activeCmd || m_state == DSinterrupted)
+	return;
+
+    // answer right away, followed by the prompt that GdbDriver sets
+    int oldSize = m_output.size();
+    if (const QByteArray* output = findResult(m_activeCmd))
+	m_output += *output;
+    m_output += prompt;
+    processOutput(oldSize);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef REPLAYDRIVER_H
+#define REPLAYDRIVER_H
+
+#include "gdbdriver.h"
+#include "transcript.h"
+
+
+/**
+ * This driver does not talk to a debugger, but answers the commands with
+ * the output that was recorded in an earlier session (see
+ * DebuggerDriver::setRecordFileName()). It allows to measure the parsers
+ * and window updates with real sessions, independently of gdb.
+ *
+ * A command receives the output of the first recorded command of the
+ * same kind and with the same command string that was not used yet. Only
+ * for commands that name terminals, files, or processes, which differ
+ * between sessions, the command string is ignored if there is no such
+ * record; other commands receive no output. A dummy process takes
+ * the place of gdb so that the commands are acknowledged as usual.
+ */
+class ReplayDriver : public GdbDriver
+{
+    Q_OBJECT
+public:
+    explicit ReplayDriver(const QString& fileName);
+    ~ReplayDriver();
+
+    bool startup(QString cmdStr) override;
+    void terminate() override;
+    void detachAndTerminate() override;
+    void interruptInferior() override;
+
+protected:
+    QString m_fileName;
+    std::vector<TranscriptRecord> m_results;	/* only RTresult records */
+    std::vector<bool> m_used;
+    size_t m_cursor = 0;		/* all results before it are used */
+
+    bool canPipeline(const CmdQueueItem* cmd) const override;
+    const QByteArray* findResult(const CmdQueueItem* cmd);
+
+protected Q_SLOTS:
+    void slotCommandRead() override;
+};
+
+#endif // REPLAYDRIVER_H
@@ -22,6 +22,8 @@
 #include <kxmlguiwindow.h>
 #include <kxmlguifactory.h>
 #include <algorithm>
+#include <cstring>
+#include <sys/stat.h>			/* stat(2) */
 #include "mydebug.h"
 
 
@@ -33,6 +35,9 @@ SourceWindow::SourceWindow(const QString& fileName, QWidget* parent) :
 	m_widthLineNo(30),
 	m_lineInfoArea(new LineInfoArea(this))
 {
+    // to recognize the file when it is opened under a different name
+    m_canonicalPath = QFileInfo(fileName).canonicalFilePath();
+
     // Center the cursor when moving it into view
     setCenterOnScroll(true);
 
@@ -46,6 +51,8 @@ SourceWindow::SourceWindow(const QString& fileName, QWidget* parent) :
     m_brkorph = KIconLoader::global()->loadIcon(QStringLiteral("brkorph"), KIconLoader::User);
     setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
     setReadOnly(true);
+    // the text is never edited, and disassembly must not pile up undo steps
+    document()->setUndoRedoEnabled(false);
     setViewportMargins(lineInfoAreaWidth(), 0, 0 ,0);
     setWordWrapMode(QTextOption::NoWrap);
     connect(this, SIGNAL(updateRequest(const QRect&, int)),
@@ -56,6 +63,8 @@ SourceWindow::SourceWindow(const QString& fileName, QWidget* parent) :
     if (QRegularExpression(QStringLiteral("\\.(c(pp|c|\\+\\+)?|CC?|h(\\+\\+|h|pp)?|HH?)$")).match(m_fileName).hasMatch())
     {
 	m_highlighter = new HighlightCpp(this);
+	connect(this, SIGNAL(updateRequest(const QRect&, int)),
+		this, SLOT(highlightVisible()));
     }
 }
 
@@ -69,73 +78,170 @@ int SourceWindow::lineInfoAreaWidth() const
     return 3 + m_widthItems + m_widthPlus + m_widthLineNo;
 }
 
-bool SourceWindow::loadFile()
+static bool statSourceFile(const QString& fileName, SourceWindow::FileVersion& v)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(fileName).constData(), &st) != 0)
+	return false;
+    v.size = st.st_size;
+#ifdef Q_OS_DARWIN
+    const struct timespec& mt = st.st_mtimespec;
+#else
+    const struct timespec& mt = st.st_mtim;	/* POSIX.1-2008 */
+#endif
+    v.mtime = qint64(mt.tv_sec) * 1000000000 + mt.tv_nsec;
+    v.inode = st.st_ino;
+    v.device = st.st_dev;
+    return true;
+}
+
+/*
+ * Reads the file in one go and decodes it like QTextStream would, but
+ * without converting it in chunks.
+ */
+static bool readSourceFile(const QString& fileName, QString& text)
 {
-    QFile f(m_fileName);
-    if (!f.open(QIODevice::ReadOnly)) {
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
 	return false;
+
+    QByteArray data = f.readAll();
+    // UTF-16 is left to QTextStream
+    if (data.startsWith("\xff\xfe") || data.startsWith("\xfe\xff")) {
+	QTextStream t(data);
+	text = t.readAll();
+	return true;
     }
+    // skip the UTF-8 byte order mark
+    int start = data.startsWith("\xef\xbb\xbf") ? 3 : 0;
+    text = QString::fromLocal8Bit(data.constData() + start, data.size() - start);
+    return true;
+}
 
-    QTextStream t(&f);
-    setPlainText(t.readAll());
-    f.close();
+/*
+ * The highlighter does not format the rows while the text is inserted.
+ * It is started when the row mapping is complete.
+ */
+void SourceWindow::setSourceText(const QString& text)
+{
+    if (m_highlighter)
+	m_highlighter->stop();
+    setPlainText(text);
+}
 
-    int n = blockCount();
-    m_sourceCode.resize(n);
-    m_rowToLine.resize(n);
-    for (int i = 0; i < n; i++) {
-	m_rowToLine[i] = i;
+bool SourceWindow::loadFile()
+{
+    // look at the file before it is read, so that a later change is noticed
+    statSourceFile(m_fileName, m_version);
+    QString text;
+    if (!readSourceFile(m_fileName, text)) {
+	return false;
     }
+    setSourceText(text);
+
+    int n = blockCount();
+    m_numLines = n;
+    resetRows();
     m_lineItems.resize(n, 0);
 
     // set a font for line numbers
     m_lineNoFont = currentCharFormat().font();
     m_lineNoFont.setPixelSize(11);
 
+    if (m_highlighter) {
+	m_highlighter->start(text, n);
+	highlightVisible();
+    }
+
     return true;
 }
 
 void SourceWindow::reloadFile()
 {
-    QFile f(m_fileName);
-    if (!f.open(QIODevice::ReadOnly)) {
+    /*
+     * If the file was not modified, the text remains. But the code may
+     * have been rebuilt or is disassembled in a different flavor, hence,
+     * the disassembly is requested again.
+     */
+    FileVersion version;
+    if (statSourceFile(m_fileName, version) && version == m_version) {
+	TRACE("unchanged: " + m_fileName);
+	removeDisassembly();
+	m_disassembly.clear();
+	restorePrevDisass();
+	return;
+    }
+
+    QString text;
+    if (!readSourceFile(m_fileName, text)) {
 	// open failed; leave alone
 	return;
     }
+    m_version = version;
 
-    m_sourceCode.clear();		/* clear old text */
+    // expanded lines are collapsed: move their line items to the source lines
+    for (const auto& d : m_disassembly) {
+	for (uchar item : d.second.items)
+	    m_lineItems[d.first] |= item;
+    }
+    m_disassembly.clear();		/* the code may have changed */
 
-    QTextStream t(&f);
-    setPlainText(t.readAll());
-    f.close();
+    setSourceText(text);
 
-    m_sourceCode.resize(blockCount());
-    // expanded lines are collapsed: move existing line items up
-    for (size_t i = 0; i < m_lineItems.size(); i++) {
-	if (m_rowToLine[i] != int(i)) {
-	    m_lineItems[m_rowToLine[i]] |= m_lineItems[i];
-	    m_lineItems[i] = 0;
-	}
-    }
+    m_numLines = blockCount();
     // allocate line items
-    m_lineItems.resize(m_sourceCode.size(), 0);
+    m_lineItems.resize(m_numLines, 0);
+    resetRows();
 
-    m_rowToLine.resize(m_sourceCode.size());
-    for (size_t i = 0; i < m_sourceCode.size(); i++)
-	m_rowToLine[i] = i;
-
-    // Highlighting was applied above when the text was inserted into widget,
-    // but at that time m_rowToLine was not corrected, yet, so that lines
-    // that previously were assembly were painted incorrectly.
-    if (m_highlighter)
-	m_highlighter->rehighlight();
+    // highlighting needs the corrected row mapping
+    if (m_highlighter) {
+	m_highlighter->start(text, m_numLines);
+	highlightVisible();
+    }
 
     restorePrevDisass();
 }
 
+/*
+ * Removes the rows of disassembled code. Their line items move to the
+ * source lines.
+ */
+void SourceWindow::removeDisassembly()
+{
+    setUpdatesEnabled(false);
+    for (auto& d : m_disassembly) {
+	int line = d.first;
+	std::vector<uchar>& items = d.second.items;
+	if (items.empty())
+	    continue;
+	for (uchar item : items)
+	    m_lineItems[line] |= item;
+	int row = lineToRow(line);
+	int count = items.size();
+	items.clear();
+	addDisassRows(line, -count);
+	removeRows(row+1, count);
+    }
+    setUpdatesEnabled(true);
+    m_lineInfoArea->update();
+}
+
+/*
+ * Removes count rows of disassembled code starting at row first from the
+ * document. The row mapping must already be updated.
+ */
+void SourceWindow::removeRows(int first, int count)
+{
+    QTextBlock last = document()->findBlockByNumber(first+count-1);
+    QTextCursor cursor(document()->findBlockByNumber(first-1));
+    cursor.movePosition(QTextCursor::EndOfBlock);
+    cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+}
+
 void SourceWindow::scrollTo(int lineNo, const DbgAddr& address)
 {
-    if (lineNo < 0 || lineNo >= int(m_sourceCode.size()))
+    if (lineNo < 0 || lineNo >= m_numLines)
 	return;
 
     int row = lineToRow(lineNo, address);
@@ -176,7 +282,13 @@ void SourceWindow::drawLineInfoArea(QPainter* p, QPaintEvent* event)
 	    break;    // all the following blocks are lower then the region being updated
 
 	int row = block.blockNumber();
-	uchar item = m_lineItems[row];
+	int sourceRow;
+	int line = rowToLine(row, &sourceRow);
+	if (line < 0)
+	    break;			/* the document is being changed */
+	bool disassCode = row > sourceRow;
+	uchar item = disassCode ?
+	    m_disassembly[line].items[row-sourceRow-1] : m_lineItems[line];
 
 	int h = r.height();
 	p->save();
@@ -225,19 +337,19 @@ void SourceWindow::drawLineInfoArea(QPainter* p, QPaintEvent* event)
 	    p->drawPixmap(0,y,m_pcup);
 	}
 	p->translate(m_widthItems, 0);
-	if (!isRowDisassCode(row) && m_sourceCode[rowToLine(row)].canDisass) {
+	if (!disassCode && canDisass(line)) {
 	    int w = m_widthPlus;
 	    int x = w/2;
 	    int y = h/2;
 	    p->drawLine(x-2, y, x+2, y);
-	    if (!isRowExpanded(row)) {
+	    if (disassRows(line) == 0) {
 		p->drawLine(x, y-2, x, y+2);
 	    }
 	}
 	p->translate(m_widthPlus, 0);
-	if (!isRowDisassCode(row)) {
+	if (!disassCode) {
 	    p->drawText(0, 0, m_widthLineNo, h, Qt::AlignRight|Qt::AlignVCenter,
-			QString().setNum(rowToLine(row)+1));
+			QString().setNum(line+1));
 	}
 	p->restore();
     }
@@ -245,28 +357,38 @@ void SourceWindow::drawLineInfoArea(QPainter* p, QPaintEvent* event)
 
 void SourceWindow::updateLineItems(const KDebugger* dbg)
 {
-    // clear outdated breakpoints
-    for (int i = m_lineItems.size()-1; i >= 0; i--) {
-	if (m_lineItems[i] & liBPany) {
-	    // check if this breakpoint still exists
-	    int line = rowToLine(i);
-	    TRACE(QString::asprintf("checking for bp at %d", line));
-	    KDebugger::BrkptROIterator bp = dbg->breakpointsBegin();
-	    for (; bp != dbg->breakpointsEnd(); ++bp)
+    // checks if a breakpoint still exists at the row
+    auto clearOutdated = [this, dbg](int line, int row, uchar& item) {
+	if ((item & liBPany) == 0)
+	    return;
+	TRACE(QString::asprintf("checking for bp at %d", line));
+	KDebugger::BrkptROIterator bp = dbg->breakpointsBegin();
+	for (; bp != dbg->breakpointsEnd(); ++bp)
+	{
+	    if (bp->lineNo == line &&
+		fileNameMatches(bp->fileName) &&
+		lineToRow(line, bp->address) == row)
 	    {
-		if (bp->lineNo == line &&
-		    fileNameMatches(bp->fileName) &&
-		    lineToRow(line, bp->address) == i)
-		{
-		    // yes it exists; mode is changed below
-		    break;
-		}
-	    }
-	    if (bp == dbg->breakpointsEnd()) {
-		/* doesn't exist anymore, remove it */
-		m_lineItems[i] &= ~liBPany;
+		// yes it exists; mode is changed below
+		return;
 	    }
 	}
+	/* doesn't exist anymore, remove it */
+	item &= ~liBPany;
+    };
+
+    // clear outdated breakpoints
+    for (int line = 0; line < int(m_lineItems.size()); line++) {
+	if (m_lineItems[line] & liBPany)
+	    clearOutdated(line, lineToRow(line), m_lineItems[line]);
+    }
+    for (auto& d : m_disassembly) {
+	std::vector<uchar>& items = d.second.items;
+	if (items.empty())
+	    continue;
+	int row = lineToRow(d.first);
+	for (size_t i = 0; i < items.size(); i++)
+	    clearOutdated(d.first, row+1+i, items[i]);
     }
 
     // add new breakpoints
@@ -275,7 +397,7 @@ void SourceWindow::updateLineItems(const KDebugger* dbg)
 	if (fileNameMatches(bp->fileName)) {
 	    TRACE(QString("updating %2:%1").arg(bp->lineNo).arg(bp->fileName));
 	    int i = bp->lineNo;
-	    if (i < 0 || i >= int(m_sourceCode.size()))
+	    if (i < 0 || i >= m_numLines)
 		continue;
 	    // compute new line item flags for breakpoint
 	    uchar flags = bp->enabled ? liBP : liBPdisabled;
@@ -286,10 +408,10 @@ void SourceWindow::updateLineItems(const KDebugger* dbg)
 	    if (bp->isOrphaned())
 		flags |= liBPorphan;
 	    // update if changed
-	    int row = lineToRow(i, bp->address);
-	    if ((m_lineItems[row] & liBPany) != flags) {
-		m_lineItems[row] &= ~liBPany;
-		m_lineItems[row] |= flags;
+	    uchar& item = rowItems(lineToRow(i, bp->address));
+	    if ((item & liBPany) != flags) {
+		item &= ~liBPany;
+		item |= flags;
 	    }
 	}
     }
@@ -298,23 +420,23 @@ void SourceWindow::updateLineItems(const KDebugger* dbg)
 
 void SourceWindow::setPC(bool set, int lineNo, const DbgAddr& address, int frameNo)
 {
-    if (lineNo < 0 || lineNo >= int(m_sourceCode.size())) {
+    if (lineNo < 0 || lineNo >= m_numLines) {
 	return;
     }
 
-    int row = lineToRow(lineNo, address);
+    uchar& item = rowItems(lineToRow(lineNo, address));
 
     uchar flag = frameNo == 0  ?  liPC  :  liPCup;
     if (set) {
 	// set only if not already set
-	if ((m_lineItems[row] & flag) == 0) {
-	    m_lineItems[row] |= flag;
+	if ((item & flag) == 0) {
+	    item |= flag;
 	    m_lineInfoArea->update();
 	}
     } else {
 	// clear only if not set
-	if ((m_lineItems[row] & flag) != 0) {
-	    m_lineItems[row] &= ~flag;
+	if ((item & flag) != 0) {
+	    item &= ~flag;
 	    m_lineInfoArea->update();
 	}
     }
@@ -378,7 +500,7 @@ void SourceWindow::infoMousePress(QMouseEvent* ev)
     if (row > sourceRow) {
 	// get offset from source code line
 	int off = row - sourceRow;
-	address = m_sourceCode[line].disassAddr[off-1];
+	address = m_disassembly[line].disassAddr[off-1];
     }
 
     switch (ev->button()) {
@@ -540,13 +662,18 @@ bool SourceWindow::fileNameMatches(const QString& other)
     return QFileInfo(other).fileName() == QFileInfo(m_fileName).fileName();
 }
 
+bool SourceWindow::isCanonicalPath(const QString& canonicalPath) const
+{
+    return !m_canonicalPath.isEmpty() && m_canonicalPath == canonicalPath;
+}
+
 void SourceWindow::disassembled(int lineNo, const std::list<DisassembledCode>& disass)
 {
     TRACE("disassembled line " + QString().setNum(lineNo));
-    if (lineNo < 0 || lineNo >= int(m_sourceCode.size()))
+    if (lineNo < 0 || lineNo >= m_numLines)
 	return;
 
-    SourceLine& sl = m_sourceCode[lineNo];
+    SourceLine& sl = m_disassembly[lineNo];
 
     // copy disassembled code and its addresses
     sl.disass.resize(disass.size());
@@ -571,94 +698,112 @@ void SourceWindow::disassembled(int lineNo, const std::list<DisassembledCode>& d
     }
 }
 
-int SourceWindow::rowToLine(int row, int* sourceRow)
-{
-    int line = row >= 0  ?  m_rowToLine[row]  :  -1;
-    if (sourceRow) {
-	// search back until we hit the first entry with the current line number
-	while (row > 0 && m_rowToLine[row-1] == line)
-	    row--;
-	*sourceRow = row;
-    }
-    return line;
-}
-
 /*
- * Rows showing diassembled code have the same line number as the
- * corresponding source code line number. Therefore, the line numbers in
- * m_rowToLine are monotonically increasing with blocks of equal line
- * numbers for a source line and its disassembled code that follows it.
- *
- * Hence, m_rowToLine always obeys the following condition:
- *
- *    m_rowToLine[i] <= i
+ * Rows showing disassembled code follow the row of their source line. The
+ * number of such rows below each line is kept in the Fenwick tree
+ * m_disassRowsTree: entry i holds the sum of the counts of the lines
+ * i-(i&-i) ... i-1. Hence, the row of a line is the line number plus the
+ * prefix sum of the counts of the lines above it, and both directions of
+ * the mapping as well as an update need O(log n) steps.
  */
 
-int SourceWindow::lineToRow(int line)
+void SourceWindow::resetRows()
 {
-    // line is zero-based!
-
-    assert(line < int(m_rowToLine.size()));
+    m_disassRowsTree.assign(m_numLines+1, 0);
+    m_numRows = m_numLines;
+}
 
-    // quick test for common case
-    if (line < 0 || m_rowToLine[line] == line)
-	return line;
+void SourceWindow::addDisassRows(int line, int count)
+{
+    for (int i = line+1; i <= m_numLines; i += i & -i)
+	m_disassRowsTree[i] += count;
+    m_numRows += count;
+}
 
-    assert(m_rowToLine[line] < line);
+int SourceWindow::rowToLine(int row, int* sourceRow)
+{
+    if (row < 0 || row >= m_numRows) {
+	if (sourceRow)
+	    *sourceRow = row;
+	return -1;
+    }
 
     /*
-     * Binary search between row == line and end of list. In the loop below
-     * we use the fact that the line numbers m_rowToLine do not contain
-     * holes.
+     * Find the last line whose source row is not after row. We descend
+     * the tree from the largest power of two; acc is the source row of
+     * line pos.
      */
-    int l = line;
-    int h = m_rowToLine.size();
-    while (l < h && m_rowToLine[l] != line)
-    {
-	assert(h == int(m_rowToLine.size()) || m_rowToLine[l] < m_rowToLine[h]);
-
-	/*
-	 * We want to round down the midpoint so that we find the
-	 * lowest row that belongs to the line we seek.
-	 */
-	int mid = (l+h)/2;
-	if (m_rowToLine[mid] <= line)
-	    l = mid;
-	else
-	    h = mid;
+    int pos = 0;
+    int acc = 0;
+    int step = 1;
+    while (step*2 <= m_numLines)
+	step *= 2;
+    for (; step > 0; step /= 2) {
+	int next = pos + step;
+	if (next <= m_numLines && acc + step + m_disassRowsTree[next] <= row) {
+	    pos = next;
+	    acc += step + m_disassRowsTree[next];
+	}
     }
-    // Found! Result is in l:
-    assert(m_rowToLine[l] == line);
+    if (sourceRow)
+	*sourceRow = acc;
+    return pos;
+}
 
-    /*
-     * We might not have hit the lowest index for the line.
-     */
-    while (l > 0 && m_rowToLine[l-1] == line)
-	--l;
+int SourceWindow::lineToRow(int line)
+{
+    // line is zero-based!
+
+    assert(line < m_numLines);
 
-    return l;
+    int row = line;
+    for (int i = line; i > 0; i &= i-1)
+	row += m_disassRowsTree[i];
+    return row;
 }
 
 int SourceWindow::lineToRow(int line, const DbgAddr& address)
 {
     int row = lineToRow(line);
-    if (isRowExpanded(row)) {
-	row += m_sourceCode[line].findAddressRowOffset(address);
+    if (disassRows(line) > 0) {
+	row += m_disassembly[line].findAddressRowOffset(address);
     }
     return row;
 }
 
+int SourceWindow::disassRows(int line) const
+{
+    auto sl = m_disassembly.find(line);
+    return sl == m_disassembly.end()  ?  0  :  int(sl->second.items.size());
+}
+
 bool SourceWindow::isRowExpanded(int row)
 {
     assert(row >= 0);
-    return row < int(m_rowToLine.size())-1 &&
-	m_rowToLine[row] == m_rowToLine[row+1];
+    int sourceRow;
+    int line = rowToLine(row, &sourceRow);
+    return line >= 0 && row == sourceRow && disassRows(line) > 0;
 }
 
 bool SourceWindow::isRowDisassCode(int row)
 {
-    return row > 0 && row < int(m_rowToLine.size()) &&
-	m_rowToLine[row] == m_rowToLine[row-1];
+    int sourceRow;
+    int line = rowToLine(row, &sourceRow);
+    return line >= 0 && row > sourceRow;
+}
+
+/*
+ * Returns the line items of a row, which belong either to a source line
+ * or to a row of disassembled code.
+ */
+uchar& SourceWindow::rowItems(int row)
+{
+    int sourceRow;
+    int line = rowToLine(row, &sourceRow);
+    assert(line >= 0);
+    if (row == sourceRow)
+	return m_lineItems[line];
+    return m_disassembly[line].items[row-sourceRow-1];
 }
 
 void SourceWindow::expandRow(int row)
@@ -666,22 +811,24 @@ void SourceWindow::expandRow(int row)
     TRACE("expanding row " + QString().setNum(row));
     // get disassembled code
     int line = rowToLine(row);
-    const std::vector<QString>& disass = m_sourceCode[line].disass;
+    SourceLine& sl = m_disassembly[line];
+    const std::vector<QString>& disass = sl.disass;
 
     // remove PC (must be set again in slot of signal expanded())
-    m_lineItems[row] &= ~(liPC|liPCup);
+    m_lineItems[line] &= ~(liPC|liPCup);
 
     // insert new lines
     setUpdatesEnabled(false);
-    ++row;
-    m_rowToLine.insert(m_rowToLine.begin()+row, disass.size(), line);
-    m_lineItems.insert(m_lineItems.begin()+row, disass.size(), 0);
+    sl.items.assign(disass.size(), 0);
+    addDisassRows(line, disass.size());
 
-    QTextCursor cursor(document()->findBlockByNumber(row));
+    QTextCursor cursor(document()->findBlockByNumber(row+1));
+    cursor.beginEditBlock();
     for (size_t i = 0; i < disass.size(); i++) {
 	cursor.insertText(disass[i]);
 	cursor.insertBlock();
     }
+    cursor.endEditBlock();
     setUpdatesEnabled(true);
 
     registerExpandedLine(line);
@@ -694,20 +841,12 @@ void SourceWindow::collapseRow(int row)
     TRACE("collapsing row " + QString().setNum(row));
     int line = rowToLine(row);
 
-    // find end of this block
-    int end = row+1;
-    while (end < int(m_rowToLine.size()) && m_rowToLine[end] == m_rowToLine[row]) {
-	end++;
-    }
-    ++row;
+    std::vector<uchar>& items = m_disassembly[line].items;
+    int count = items.size();
     setUpdatesEnabled(false);
-    QTextCursor cursor(document()->findBlockByNumber(end-1));
-    while (--end >= row) {
-	m_rowToLine.erase(m_rowToLine.begin()+end);
-	m_lineItems.erase(m_lineItems.begin()+end);
-	cursor.select(QTextCursor::BlockUnderCursor);
-	cursor.removeSelectedText();
-    }
+    items.clear();
+    addDisassRows(line, -count);
+    removeRows(row+1, count);
     setUpdatesEnabled(true);
 
     unregisterExpandedLine(line);
@@ -723,8 +862,37 @@ void SourceWindow::activeLine(int& line, DbgAddr& address)
     line = rowToLine(row, &sourceRow);
     if (row > sourceRow) {
 	int off = row - sourceRow;	/* offset from source line */
-	address = m_sourceCode[line].disassAddr[off-1];
+	address = m_disassembly[line].disassAddr[off-1];
+    }
+}
+
+/*
+ * Formats the rows that are in view, see HighlightCpp.
+ */
+void SourceWindow::highlightVisible()
+{
+    if (!m_highlighter)
+	return;
+    QTextBlock block = firstVisibleBlock();
+    if (!block.isValid())
+	return;
+    int first = block.blockNumber();
+    int last = first;
+    int height = viewport()->height();
+    QPointF offset = contentOffset();
+    for (; block.isValid(); block = block.next()) {
+	if (blockBoundingGeometry(block).translated(offset).top() > height)
+	    break;
+	last = block.blockNumber();
     }
+    m_highlighter->highlightRows(first, last);
+}
+
+bool SourceWindow::canDisass(int line) const
+{
+    // a line that was not tried yet may have code
+    auto sl = m_disassembly.find(line);
+    return sl == m_disassembly.end() || sl->second.canDisass;
 }
 
 /**
@@ -737,23 +905,21 @@ int SourceWindow::SourceLine::findAddressRowOffset(const DbgAddr& address) const
     if (address.isEmpty())
 	return 0;
 
-    for (size_t i = 0; i < disassAddr.size(); i++) {
-	if (disassAddr[i] == address) {
-	    // found exact address
-	    return i+1;
-	}
-	if (disassAddr[i] > address) {
-	    /*
-	     * We have already advanced too far; the address is before this
-	     * index, but obviously we haven't found an exact match
-	     * earlier. address is somewhere between the displayed
-	     * addresses. We return the previous line.
-	     */
-	    return i;
-	}
-    }
-    // not found
-    return 0;
+    // the addresses are sorted; find the first that is not lower
+    auto it = std::lower_bound(disassAddr.begin(), disassAddr.end(), address,
+		[](const DbgAddr& a, const DbgAddr& b) {
+		    return !(a > b) && !(a == b);
+		});
+    if (it == disassAddr.end())
+	return 0;		/* not found */
+    int i = it - disassAddr.begin();
+    if (*it == address)
+	return i+1;		/* found exact address */
+    /*
+     * The address is somewhere between the displayed addresses. We
+     * return the previous line.
+     */
+    return i;
 }
 
 void SourceWindow::actionExpandRow(int row)
@@ -763,10 +929,10 @@ void SourceWindow::actionExpandRow(int row)
 
     // disassemble
     int line = rowToLine(row);
-    const SourceLine& sl = m_sourceCode[line];
-    if (!sl.canDisass)
+    if (!canDisass(line))
 	return;
-    if (sl.disass.size() == 0) {
+    auto sl = m_disassembly.find(line);
+    if (sl == m_disassembly.end() || sl->second.disass.empty()) {
 	Q_EMIT disassemble(m_fileName, line);
     } else {
 	expandRow(row);
@@ -803,9 +969,15 @@ void SourceWindow::unregisterExpandedLine(int line)
 
 void SourceWindow::restorePrevDisass()
 {
-    for(auto lineNo : m_expandedLines)
+    // the lines are registered again when they are expanded
+    std::vector<int> lines;
+    lines.swap(m_expandedLines);
+    for(auto lineNo : lines)
     {
-        QTimer::singleShot(500, [this, lineNo](){actionExpandRow(lineNo);});
+        QTimer::singleShot(500, this, [this, lineNo](){
+	    if (lineNo < m_numLines)
+		actionExpandRow(lineToRow(lineNo));
+	});
     }
 }
 
@@ -870,6 +1042,11 @@ HighlightCpp::HighlightCpp(SourceWindow* srcWnd) :
 {
 }
 
+HighlightCpp::~HighlightCpp()
+{
+    stop();
+}
+
 enum HLState {
     hlCommentLine = 1,
     hlCommentBlock,
@@ -877,6 +1054,106 @@ enum HLState {
     hlString
 };
 
+// what the pieces of text are that the scanner finds
+enum HLKind { hkText, hkComment, hkString, hkIdent, hkPreprocessor };
+
+// the block state of rows that have been formatted
+static const int blockFormatted = 1;
+
+/*
+ * Scans one line of code that starts in the given state. The pieces of
+ * the line are handed to format(start, length, kind). Returns the state
+ * at the end of the line.
+ */
+template<class Format>
+static int scanCpp(QStringView text, int state, Format format)
+{
+    const int len = int(text.size());
+
+    if (state < 0)		// initial state
+	state = 0;
+
+    // check for preprocessor line
+    if (state == 0 && text.trimmed().startsWith(QLatin1Char('#')))
+    {
+	format(0, len, hkPreprocessor);
+	return 0;
+    }
+
+    int start = 0;
+    while (start < len)
+    {
+	int end;
+	switch (state) {
+	case hlCommentLine:
+	    end = len;
+	    state = 0;
+	    format(start, end-start, hkComment);
+	    break;
+	case hlCommentBlock:
+	    end = int(text.indexOf(QStringView(u"*/"), start));
+	    if (end >= 0)
+		end += 2, state = 0;
+	    else
+		end = len;
+	    format(start, end-start, hkComment);
+	    break;
+	case hlString:
+	    for (end = start+1; end < len; end++) {
+		if (text[end] == QLatin1Char('\\')) {
+		    if (end < len)
+			++end;
+		} else if (text[end] == text[start]) {
+		    ++end;
+		    break;
+		}
+	    }
+	    state = 0;
+	    format(start, end-start, hkString);
+	    break;
+	case hlIdent:
+	    for (end = start+1; end < len; end++) {
+		if (!text[end].isLetterOrNumber() && text[end] != QLatin1Char('_'))
+		    break;
+	    }
+	    state = 0;
+	    format(start, end-start, hkIdent);
+	    break;
+	default:
+	    for (end = start; end < len; end++)
+	    {
+		if (text[end] == QLatin1Char('/'))
+		{
+		    if (end+1 < len) {
+			if (text[end+1] == QLatin1Char('/')) {
+			    state = hlCommentLine;
+			    break;
+			} else if (text[end+1] == QLatin1Char('*')) {
+			    state = hlCommentBlock;
+			    break;
+			}
+		    }
+		}
+		else if (text[end] == QLatin1Char('"') || text[end] == QLatin1Char('\''))
+		{
+		    state = hlString;
+		    break;
+		}
+		else if ((text[end] >= QLatin1Char('A') && text[end] <= QLatin1Char('Z')) ||
+			 (text[end] >= QLatin1Char('a') && text[end] <= QLatin1Char('z')) ||
+			 text[end] == QLatin1Char('_'))
+		{
+		    state = hlIdent;
+		    break;
+		}
+	    }
+	    format(start, end-start, hkText);
+	}
+	start = end;
+    }
+    return state;
+}
+
 static const char* const ckw[] =
 {
     "alignas",
@@ -967,114 +1244,169 @@ static const char* const ckw[] =
 
 void HighlightCpp::highlightBlock(const QString& text)
 {
-    int state = previousBlockState();
-    state = highlight(text, state);
-    setCurrentBlockState(state);
-}
+    int row = currentBlock().blockNumber();
+    if (!m_active || row < m_firstRow || row > m_lastRow) {
+	// it is formatted when it becomes visible, see highlightRows()
+	setCurrentBlockState(-1);
+	return;
+    }
 
-int HighlightCpp::highlight(const QString& text, int state)
-{
     // highlight assembly lines
-    if (m_srcWnd->isRowDisassCode(currentBlock().blockNumber()))
-    {
+    if (m_srcWnd->isRowDisassCode(row))
 	setFormat(0, text.length(), Qt::blue);
-	return state;
-    }
-
-    if (state == -2)		// initial state
-	state = 0;
-
-    // check for preprocessor line
-    if (state == 0 && text.trimmed().startsWith(QLatin1Char('#')))
-    {
-	setFormat(0, text.length(), QColor("darkgreen"));
-	return 0;
-    }
+    else
+	highlight(text, lineState(m_srcWnd->rowToLine(row)));
+    setCurrentBlockState(blockFormatted);
+}
 
+int HighlightCpp::highlight(const QString& text, int state)
+{
     // a font for keywords
     QTextCharFormat identFont;
     identFont.setFontWeight(QFont::Bold);
-
-    int start = 0;
-    while (start < text.length())
-    {
-	int end;
-	switch (state) {
-	case hlCommentLine:
-	    end = text.length();
-	    state = 0;
-	    setFormat(start, end-start, QColor("gray"));
+    const QColor textColor = m_srcWnd->palette().color(QPalette::WindowText);
+    const QColor commentColor("gray");
+    const QColor stringColor("darkred");
+    const QColor preprocessorColor("darkgreen");
+
+    return scanCpp(text, state, [&](int start, int len, HLKind kind) {
+	switch (kind) {
+	case hkComment:
+	    setFormat(start, len, commentColor);
 	    break;
-	case hlCommentBlock:
-	    end = text.indexOf(QStringLiteral("*/"), start);
-	    if (end >= 0)
-		end += 2, state = 0;
-	    else
-		end = text.length();
-	    setFormat(start, end-start, QColor("gray"));
+	case hkString:
+	    setFormat(start, len, stringColor);
 	    break;
-	case hlString:
-	    for (end = start+1; end < int(text.length()); end++) {
-		if (text[end] == QLatin1Char('\\')) {
-		    if (end < int(text.length()))
-			++end;
-		} else if (text[end] == text[start]) {
-		    ++end;
-		    break;
-		}
-	    }
-	    state = 0;
-	    setFormat(start, end-start, QColor("darkred"));
+	case hkPreprocessor:
+	    setFormat(start, len, preprocessorColor);
 	    break;
-	case hlIdent:
-	    for (end = start+1; end < int(text.length()); end++) {
-		if (!text[end].isLetterOrNumber() && text[end] != QLatin1Char('_'))
-		    break;
-	    }
-	    state = 0;
-	    if (isCppKeyword(text.mid(start, end-start)))
-	    {
-		setFormat(start, end-start, identFont);
-	    } else {
-		setFormat(start, end-start, m_srcWnd->palette().color(QPalette::WindowText));
+	case hkIdent:
+	    if (isCppKeyword(QStringView(text).mid(start, len))) {
+		setFormat(start, len, identFont);
+		break;
 	    }
+	    Q_FALLTHROUGH();
+	case hkText:
+	    setFormat(start, len, textColor);
 	    break;
-	default:
-	    for (end = start; end < int(text.length()); end++)
-	    {
-		if (text[end] == QLatin1Char('/'))
-		{
-		    if (end+1 < int(text.length())) {
-			if (text[end+1] == QLatin1Char('/')) {
-			    state = hlCommentLine;
-			    break;
-			} else if (text[end+1] == QLatin1Char('*')) {
-			    state = hlCommentBlock;
-			    break;
-			}
-		    }
-		}
-		else if (text[end] == QLatin1Char('"') || text[end] == QLatin1Char('\''))
-		{
-		    state = hlString;
-		    break;
-		}
-		else if ((text[end] >= QLatin1Char('A') && text[end] <= QLatin1Char('Z')) ||
-			 (text[end] >= QLatin1Char('a') && text[end] <= QLatin1Char('z')) ||
-			 text[end] == QLatin1Char('_'))
-		{
-		    state = hlIdent;
-		    break;
-		}
-	    }
-	    setFormat(start, end-start, m_srcWnd->palette().color(QPalette::WindowText));
 	}
-	start = end;
+    });
+}
+
+void HighlightCpp::stop()
+{
+    if (m_worker.joinable()) {
+	m_cancel = true;
+	m_worker.join();
+	m_cancel = false;
     }
-    return state;
+    m_active = false;
+    m_firstRow = 0;
+    m_lastRow = -1;
+}
+
+void HighlightCpp::start(const QString& text, int numLines)
+{
+    stop();
+    m_lineStates.assign(numLines, 0);
+    m_linesDone = 0;
+    m_worker = std::thread(&HighlightCpp::computeLineStates, this, text);
+    m_active = true;
+}
+
+void HighlightCpp::highlightRows(int first, int last)
+{
+    // formatting a row can trigger another update request
+    if (!m_active || m_inHighlightRows)
+	return;
+    m_inHighlightRows = true;
+    m_firstRow = first;
+    m_lastRow = last;
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int row = first; row <= last && block.isValid(); row++) {
+	if (block.userState() != blockFormatted)
+	    rehighlightBlock(block);
+	block = block.next();
+    }
+    m_inHighlightRows = false;
+}
+
+/*
+ * The state at the start of a source line. If the worker has not got
+ * there yet, we wait only until it has.
+ */
+int HighlightCpp::lineState(int line)
+{
+    // the first line always starts in the initial state
+    if (line <= 0 || line >= int(m_lineStates.size()))
+	return 0;
+    if (line >= m_linesDone.load(std::memory_order_acquire)) {
+	std::unique_lock<std::mutex> lock(m_progressMutex);
+	m_progress.wait(lock, [this, line]() {
+	    return line < m_linesDone.load(std::memory_order_acquire);
+	});
+    }
+    return m_lineStates[line];
+}
+
+/*
+ * Runs in the worker thread. The text is split into lines in the same way
+ * as QTextDocument splits it into blocks.
+ */
+void HighlightCpp::computeLineStates(QString text)
+{
+    const QChar* p = text.constData();
+    const QChar* end = p + text.size();
+    const int numLines = int(m_lineStates.size());
+    int state = 0;
+    for (int line = 0; line < numLines; ) {
+	const QChar* eol = p;
+	while (eol < end && *eol != QLatin1Char('\n') && *eol != QLatin1Char('\r') &&
+	       *eol != QChar::ParagraphSeparator)
+	    ++eol;
+	m_lineStates[line] = state;
+	state = scanCpp(QStringView(p, eol), state, [](int, int, HLKind) {});
+	m_linesDone.store(++line, std::memory_order_release);
+	if (eol == end)
+	    break;
+	if (*eol == QLatin1Char('\r') && eol+1 < end && eol[1] == QLatin1Char('\n'))
+	    ++eol;
+	p = eol+1;
+	if (line % 1024 == 0) {
+	    if (m_cancel)
+		return;
+	    notifyProgress();
+	}
+    }
+    m_linesDone.store(numLines, std::memory_order_release);
+    notifyProgress();
+}
+
+void HighlightCpp::notifyProgress()
+{
+    // lineState() must not miss the update between its check and the wait
+    { std::lock_guard<std::mutex> lock(m_progressMutex); }
+    m_progress.notify_all();
+}
+
+/*
+ * Compares a keyword with a word without converting the word. Returns
+ * <0, 0, or >0 like strcmp().
+ */
+static int compareKeyword(const char* kw, QStringView word)
+{
+    int i = 0;
+    for (; kw[i] != '\0' && i < word.size(); i++) {
+	ushort c = word[i].unicode();
+	if (uchar(kw[i]) != c)
+	    return uchar(kw[i]) < c ? -1 : 1;
+    }
+    if (kw[i] != '\0')
+	return 1;
+    return i < word.size() ? -1 : 0;
 }
 
-bool HighlightCpp::isCppKeyword(const QString& word)
+bool HighlightCpp::isCppKeyword(QStringView word)
 {
     struct StringCompare {
 	bool operator()(const char* a, const char* b) const {
@@ -1084,7 +1416,7 @@ bool HighlightCpp::isCppKeyword(const QString& word)
     using std::begin;
     using std::end;
 #ifndef NDEBUG
-    // std::binary_search requires the search list to be sorted
+    // std::lower_bound requires the search list to be sorted
     static bool keyword_order_verified = false;
     if (!keyword_order_verified) {
 	assert(std::is_sorted(begin(ckw), end(ckw), StringCompare{}));
@@ -1092,5 +1424,9 @@ bool HighlightCpp::isCppKeyword(const QString& word)
     }
 #endif
 
-    return std::binary_search(begin(ckw), end(ckw), word.toLocal8Bit().data(), StringCompare{});
+    auto kw = std::lower_bound(begin(ckw), end(ckw), word,
+			       [](const char* a, QStringView w) {
+				   return compareKeyword(a, w) < 0;
+			       });
+    return kw != end(ckw) && compareKeyword(*kw, word) == 0;
 }
@@ -10,6 +10,11 @@
 #include <QPixmap>
 #include <QPlainTextEdit>
 #include <QSyntaxHighlighter>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include "dbgdriver.h"
 
@@ -29,6 +34,8 @@ public:
     bool loadFile();
     void reloadFile();
     bool fileNameMatches(const QString& other);
+    /** whether the window shows the file with this canonical path */
+    bool isCanonicalPath(const QString& canonicalPath) const;
     void scrollTo(int lineNo, const DbgAddr& address);
     const QString& fileName() const { return m_fileName; }
     void updateLineItems(const KDebugger* dbg);
@@ -57,6 +64,18 @@ public:
     static QString extendExpr(const QString &plainText,
                               int            wordStart,
                               int            wordEnd);
+
+    /** Identifies the version of a file: it changes when the file is written. */
+    struct FileVersion {
+	qint64 size = -1;
+	qint64 mtime = 0;		/* nanoseconds */
+	quint64 inode = 0;
+	quint64 device = 0;
+	bool operator==(const FileVersion& o) const {
+	    return size == o.size && mtime == o.mtime &&
+		inode == o.inode && device == o.device;
+	}
+    };
 protected:
     void drawLineInfoArea(QPainter* p, QPaintEvent* event);
     void infoMousePress(QMouseEvent* ev);
@@ -92,6 +111,8 @@ Q_SIGNALS:
 public Q_SLOTS:
     void setTabWidth(int numChars);
     void cursorChanged();
+protected Q_SLOTS:
+    void highlightVisible();
 
 protected:
     QString m_fileName;
@@ -104,15 +125,38 @@ protected:
     struct SourceLine {
 	std::vector<QString> disass;		/* its disassembled code */
 	std::vector<DbgAddr> disassAddr;	/* the addresses thereof */
+	std::vector<uchar> items;		/* icons of the rows while expanded */
 	bool canDisass;			/* if line can be disassembled */
 	SourceLine() : canDisass(true) { }
 	int findAddressRowOffset(const DbgAddr& address) const;
     };
-    std::vector<SourceLine> m_sourceCode;
+    int m_numLines = 0;			//!< The number of source lines
+    /**
+     * The disassembled code of those lines that were disassembled, keyed
+     * by line number. Most lines are never disassembled, hence, there is
+     * no entry per line.
+     */
+    std::map<int,SourceLine> m_disassembly;
+    bool canDisass(int line) const;
+    void setSourceText(const QString& text);
+    void removeDisassembly();
+    void removeRows(int first, int count);
+    uchar& rowItems(int row);
+    /** the number of rows of disassembled code shown below the line */
+    int disassRows(int line) const;
+    FileVersion m_version;		//!< The version of the file that is shown
+    QString m_canonicalPath;
     HighlightCpp* m_highlighter = {};
 
-    std::vector<int> m_rowToLine;	//!< The source line number for each row
-    std::vector<uchar> m_lineItems;	//!< Icons displayed on the line
+    /**
+     * The number of rows of disassembled code below each line as a Fenwick
+     * tree, so that rows and lines can be mapped in O(log n).
+     */
+    std::vector<int> m_disassRowsTree;
+    int m_numRows = 0;			//!< The number of rows of the document
+    void resetRows();
+    void addDisassRows(int line, int count);
+    std::vector<uchar> m_lineItems;	//!< Icons displayed on the source lines
     std::vector<int> m_expandedLines;	//!< Keep track of expanded line numbers
     QPixmap m_pcinner;			/* PC at innermost frame */
     QPixmap m_pcup;			/* PC at frame up the stack */
@@ -139,16 +183,51 @@ public:
     void contextMenuEvent(QContextMenuEvent* e) override;
 };
 
+/**
+ * Highlights C and C++ code. Only the rows that are visible are formatted;
+ * the others are formatted when they are scrolled into view. The state
+ * at the start of each source line is computed by a background thread.
+ */
 class HighlightCpp : public QSyntaxHighlighter
 {
     SourceWindow* m_srcWnd;
 
 public:
     HighlightCpp(SourceWindow* srcWnd);
+    ~HighlightCpp();
     void highlightBlock(const QString& text) override;
     int highlight(const QString& text, int state);
 
-    static bool isCppKeyword(const QString& word);
+    /**
+     * Stops formatting. Must be called before the text of the document
+     * is replaced.
+     */
+    void stop();
+    /**
+     * Starts to compute the line states of the new text in the background
+     * and allows to format rows again.
+     */
+    void start(const QString& text, int numLines);
+    /** Formats the rows from first to last (inclusive) that are not yet. */
+    void highlightRows(int first, int last);
+
+    static bool isCppKeyword(QStringView word);
+
+protected:
+    bool m_active = false;		/* whether rows can be formatted */
+    bool m_inHighlightRows = false;
+    int m_firstRow = 0;			/* the rows that may be formatted */
+    int m_lastRow = -1;
+    std::vector<uchar> m_lineStates;	/* the state at the start of each line */
+    std::atomic<int> m_linesDone{0};	/* lines whose state is known */
+    std::atomic<bool> m_cancel{false};
+    std::mutex m_progressMutex;		/* for m_progress */
+    std::condition_variable m_progress;	/* m_linesDone went up */
+    std::thread m_worker;
+
+    int lineState(int line);
+    void computeLineStates(QString text);
+    void notifyProgress();
 };
 
 #endif // SOURCEWND_H
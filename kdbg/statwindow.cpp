@@ -0,0 +1,194 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "statwindow.h"
+#include "cmdstats.h"
+#include "dbgdriver.h"
+#include "debugger.h"
+#include <klocalizedstring.h>
+#include <kmessagebox.h>
+#include <QContextMenuEvent>
+#include <QFile>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QSet>
+
+enum {
+    COL_CMD, COL_COUNT, COL_WAIT, COL_DBG50, COL_DBG99, COL_PARSE50,
+    COL_PARSE99, COL_BYTES
+};
+
+StatisticsWindow::StatisticsWindow(QWidget* parent) :
+	QTreeWidget(parent)
+{
+    setHeaderLabels(QStringList()
+	<< i18n("Command")
+	<< i18n("Count")
+	<< i18n("Wait (median)")
+	<< i18n("Debugger (median)")
+	<< i18n("Debugger (99%)")
+	<< i18n("Parse (median)")
+	<< i18n("Parse (99%)")
+	<< i18n("Output bytes"));
+    header()->setSectionResizeMode(COL_CMD, QHeaderView::Interactive);
+    setRootIsDecorated(false);
+    setAllColumnsShowFocus(true);
+    setSortingEnabled(true);
+    sortByColumn(COL_COUNT, Qt::DescendingOrder);
+
+    m_popup.addAction(i18n("&Save as JSON..."), this, SLOT(slotSave()));
+    m_popup.addAction(i18n("&Reset"), this, SLOT(slotReset()));
+
+    // the statistics change with every command; refresh only periodically
+    connect(&m_refreshTimer, SIGNAL(timeout()), SLOT(slotRefresh()));
+}
+
+StatisticsWindow::~StatisticsWindow()
+{
+}
+
+/*
+ * Sorts the numeric columns by value rather than by text.
+ */
+class StatisticsItem : public QTreeWidgetItem
+{
+public:
+    StatisticsItem(QTreeWidget* parent) : QTreeWidgetItem(parent) { }
+    void setValue(int col, qint64 value, const QString& text);
+    bool operator<(const QTreeWidgetItem& other) const override;
+};
+
+void StatisticsItem::setValue(int col, qint64 value, const QString& text)
+{
+    setData(col, Qt::UserRole, value);
+    setText(col, text);
+    setTextAlignment(col, Qt::AlignRight|Qt::AlignVCenter);
+}
+
+bool StatisticsItem::operator<(const QTreeWidgetItem& other) const
+{
+    int col = treeWidget() ? treeWidget()->sortColumn() : 0;
+    if (col == COL_CMD)
+	return QTreeWidgetItem::operator<(other);
+    return data(col, Qt::UserRole).toLongLong() <
+	other.data(col, Qt::UserRole).toLongLong();
+}
+
+static QString formatTime(qint64 usecs)
+{
+    if (usecs < 1000)
+	return i18n("%1 µs", usecs);
+    return i18n("%1 ms", QString::number(usecs / 1000.0, 'f', 1));
+}
+
+/*
+ * Updates the items in place, so that the selection and the scroll
+ * position remain.
+ */
+void StatisticsWindow::updateStatistics(const CommandStatistics& stats)
+{
+    if (&stats == m_shownStats && stats.changes() == m_shownChanges)
+	return;
+    m_shownStats = &stats;
+    m_shownChanges = stats.changes();
+
+    setSortingEnabled(false);
+    QSet<int> cmds;
+    for (const auto& i : stats.entries())
+    {
+	const CommandStatistics::Entry& e = i.second;
+	cmds.insert(i.first);
+	QTreeWidgetItem*& entry = m_items[i.first];
+	StatisticsItem* item = static_cast<StatisticsItem*>(entry);
+	if (!item) {
+	    entry = item = new StatisticsItem(this);
+	    item->setText(COL_CMD, e.name);
+	} else if (item->data(COL_COUNT, Qt::UserRole).toLongLong() == qint64(e.count)) {
+	    continue;			/* no new commands of this kind */
+	}
+	item->setValue(COL_COUNT, e.count, QString::number(e.count));
+	qint64 t = e.wait.percentile(50);
+	item->setValue(COL_WAIT, t, formatTime(t));
+	t = e.debugger.percentile(50);
+	item->setValue(COL_DBG50, t, formatTime(t));
+	t = e.debugger.percentile(99);
+	item->setValue(COL_DBG99, t, formatTime(t));
+	t = e.parse.percentile(50);
+	item->setValue(COL_PARSE50, t, formatTime(t));
+	t = e.parse.percentile(99);
+	item->setValue(COL_PARSE99, t, formatTime(t));
+	item->setValue(COL_BYTES, e.outputBytes, QString::number(e.outputBytes));
+    }
+    // the statistics were reset
+    for (auto it = m_items.begin(); it != m_items.end(); ) {
+	if (cmds.contains(it.key())) {
+	    ++it;
+	} else {
+	    delete it.value();
+	    it = m_items.erase(it);
+	}
+    }
+    setSortingEnabled(true);
+}
+
+void StatisticsWindow::clearItems()
+{
+    clear();
+    m_items.clear();
+    m_shownStats = nullptr;
+}
+
+void StatisticsWindow::slotRefresh()
+{
+    if (!m_debugger || !m_debugger->driver())
+	return;
+    updateStatistics(m_debugger->driver()->statistics());
+}
+
+void StatisticsWindow::showEvent(QShowEvent* ev)
+{
+    QTreeWidget::showEvent(ev);
+    slotRefresh();
+    m_refreshTimer.start(1000);
+}
+
+void StatisticsWindow::hideEvent(QHideEvent* ev)
+{
+    m_refreshTimer.stop();
+    QTreeWidget::hideEvent(ev);
+}
+
+void StatisticsWindow::slotSave()
+{
+    if (!m_debugger || !m_debugger->driver())
+	return;
+
+    QString fileName = QFileDialog::getSaveFileName(this,
+			i18n("Save Statistics"), QString(),
+			i18n("JSON files (*.json)"));
+    if (fileName.isEmpty())
+	return;
+
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly) ||
+	f.write(m_debugger->driver()->statistics().toJson()) < 0)
+    {
+	KMessageBox::error(this, i18n("Cannot write %1", fileName));
+    }
+}
+
+void StatisticsWindow::slotReset()
+{
+    if (m_debugger && m_debugger->driver())
+	m_debugger->driver()->clearStatistics();
+    clearItems();
+}
+
+void StatisticsWindow::contextMenuEvent(QContextMenuEvent* ev)
+{
+    m_popup.popup(ev->globalPos());
+    ev->accept();
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef STATWINDOW_H
+#define STATWINDOW_H
+
+#include <QHash>
+#include <QMenu>
+#include <QTimer>
+#include <QTreeWidget>
+
+class KDebugger;
+class CommandStatistics;
+
+/**
+ * Shows how long the commands sent to the debugger took: how long they
+ * waited in the queue, how long the debugger worked on them, and how
+ * long it took to handle their output.
+ */
+class StatisticsWindow : public QTreeWidget
+{
+    Q_OBJECT
+public:
+    StatisticsWindow(QWidget* parent);
+    ~StatisticsWindow();
+
+    void setDebugger(KDebugger* deb) { m_debugger = deb; }
+
+protected:
+    KDebugger* m_debugger = {};
+    QTimer m_refreshTimer;
+    QMenu m_popup;
+    QHash<int,QTreeWidgetItem*> m_items;	/* by DbgCommand */
+    // the statistics that the items show
+    const CommandStatistics* m_shownStats = {};
+    unsigned m_shownChanges = 0;
+
+    void contextMenuEvent(QContextMenuEvent* ev) override;
+    void showEvent(QShowEvent* ev) override;
+    void hideEvent(QHideEvent* ev) override;
+    void updateStatistics(const CommandStatistics& stats);
+    void clearItems();
+
+protected Q_SLOTS:
+    void slotRefresh();
+    void slotSave();
+    void slotReset();
+};
+
+#endif // STATWINDOW_H
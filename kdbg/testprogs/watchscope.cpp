@@ -0,0 +1,41 @@
+#include <stdio.h>
+
+/*
+ * Watch the expressions "total" and "item.weight" and step through the
+ * program.
+ *
+ * While the program is in weigh(), "total" is not in scope. It is shown
+ * greyed out after the first step in weigh(), and the debugger is not
+ * asked for it again at the following lines of weigh(). It is asked once
+ * more when the block with "twice" is entered or left, because the set
+ * of local variables changes. The same holds for "item.weight" in main().
+ */
+
+struct Item {
+	const char* name;
+	int weight;
+};
+
+static int weigh(Item item)
+{
+	int w = item.weight;
+	w += 1;
+	w *= 2;
+	if (w > 10) {
+		int twice = 2 * w;
+		w = twice - w;
+	}
+	w -= 1;
+	return w;
+}
+
+int main()
+{
+	Item items[] = { { "apple", 3 }, { "melon", 12 } };
+	int total = 0;
+	for (int i = 0; i < 2; i++) {
+		total += weigh(items[i]);
+	}
+	printf("total=%d\n", total);
+	return 0;
+}
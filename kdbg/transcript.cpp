@@ -0,0 +1,133 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#include "transcript.h"
+#include <QDataStream>
+#include <chrono>
+#include "mydebug.h"
+
+const char TranscriptWriter::magic[] = "KDBGREC1";
+
+// the writer thread is woken up early when this many bytes are pending
+static const int flushThreshold = 64*1024;
+
+static QByteArray readBytes(QDataStream& s)
+{
+    quint32 len = 0;
+    s >> len;
+    if (s.status() != QDataStream::Ok || len > s.device()->bytesAvailable()) {
+	s.setStatus(QDataStream::ReadPastEnd);
+	return QByteArray();
+    }
+    QByteArray data(len, Qt::Uninitialized);
+    if (s.readRawData(data.data(), len) != int(len))
+	s.setStatus(QDataStream::ReadPastEnd);
+    return data;
+}
+
+
+TranscriptWriter::TranscriptWriter(const QString& fileName) :
+	m_file(fileName)
+{
+    if (!m_file.open(QIODevice::WriteOnly)) {
+	TRACE("cannot open transcript " + fileName);
+	return;
+    }
+    m_file.write(magic, magicLen);
+    m_thread = std::thread(&TranscriptWriter::run, this);
+}
+
+TranscriptWriter::~TranscriptWriter()
+{
+    if (m_thread.joinable())
+    {
+	{
+	    std::lock_guard<std::mutex> lock(m_mutex);
+	    m_quit = true;
+	}
+	m_wakeup.notify_one();
+	m_thread.join();
+    }
+}
+
+void TranscriptWriter::write(const TranscriptRecord& rec)
+{
+    if (!m_thread.joinable())
+	return;
+
+    QByteArray data;
+    {
+	QDataStream s(&data, QIODevice::WriteOnly);
+	s.setByteOrder(QDataStream::LittleEndian);
+	s << quint8(rec.type) << rec.time << rec.cmd;
+	s << quint32(rec.command.size());
+	s.writeRawData(rec.command.constData(), rec.command.size());
+	s << quint32(rec.payload.size());
+	s.writeRawData(rec.payload.constData(), rec.payload.size());
+    }
+
+    bool wakeup;
+    {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pending += data;
+	wakeup = m_pending.size() >= flushThreshold;
+    }
+    if (wakeup)
+	m_wakeup.notify_one();
+}
+
+void TranscriptWriter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+	// write at least twice a second so that a crash does not lose much
+	m_wakeup.wait_for(lock, std::chrono::milliseconds(500), [this] {
+	    return m_quit || m_pending.size() >= flushThreshold;
+	});
+	QByteArray data;
+	data.swap(m_pending);
+	bool quit = m_quit;
+
+	lock.unlock();
+	if (!data.isEmpty()) {
+	    m_file.write(data);
+	    m_file.flush();
+	}
+	if (quit)
+	    break;
+	lock.lock();
+    }
+    m_file.close();
+}
+
+bool readTranscript(const QString& fileName, std::vector<TranscriptRecord>& records)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+	return false;
+    if (f.read(TranscriptWriter::magicLen) !=
+	QByteArray(TranscriptWriter::magic, TranscriptWriter::magicLen))
+    {
+	return false;
+    }
+
+    QDataStream s(&f);
+    s.setByteOrder(QDataStream::LittleEndian);
+    while (!s.atEnd())
+    {
+	TranscriptRecord rec;
+	quint8 type;
+	s >> type >> rec.time >> rec.cmd;
+	rec.type = TranscriptRecord::Type(type);
+	rec.command = readBytes(s);
+	rec.payload = readBytes(s);
+	if (s.status() != QDataStream::Ok)
+	    break;			/* truncated, e.g., by a crash */
+	records.push_back(rec);
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright Johannes Sixt
+ * This file is licensed under the GNU General Public License Version 2.
+ * See the file COPYING in the toplevel directory of the source directory.
+ */
+
+#ifndef TRANSCRIPT_H
+#define TRANSCRIPT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * One entry of a recorded session with the debugger.
+ */
+struct TranscriptRecord
+{
+    enum Type : quint8 {
+	RTcommand = 'C',		/* a command was sent */
+	RToutput = 'O',			/* raw output was received */
+	RTresult = 'R'			/* the output that was handed to the parsers */
+    };
+    Type type;
+    qint64 time;			/* nanoseconds since the driver was created */
+    qint32 cmd;				/* DbgCommand, -1 for RToutput */
+    QByteArray command;			/* the command string */
+    QByteArray payload;			/* the output */
+};
+
+/**
+ * Writes records to a file. The file is written by a background thread
+ * so that the debugger driver does not wait for the disk.
+ *
+ * The file starts with a magic string, followed by the records. Each
+ * record consists of the type (1 byte), the time (8 bytes), the command
+ * (4 bytes), and the lengths (4 bytes each) and contents of the command
+ * string and the payload. Numbers are little endian.
+ */
+class TranscriptWriter
+{
+public:
+    explicit TranscriptWriter(const QString& fileName);
+    ~TranscriptWriter();
+
+    bool isOpen() const { return m_file.isOpen(); }
+    void write(const TranscriptRecord& rec);
+
+    static const char magic[];
+    static const int magicLen = 8;
+
+protected:
+    QFile m_file;			/* used only by the thread */
+    QByteArray m_pending;		/* records not yet written */
+    bool m_quit = false;
+    std::mutex m_mutex;			/* protects m_pending and m_quit */
+    std::condition_variable m_wakeup;
+    std::thread m_thread;
+
+    void run();
+};
+
+/**
+ * Reads all records of a file that was written by TranscriptWriter.
+ * @return false if the file cannot be read or has the wrong format.
+ */
+bool readTranscript(const QString& fileName, std::vector<TranscriptRecord>& records);
+
+#endif // TRANSCRIPT_H
@@ -103,6 +103,16 @@ bool WinStack::activatePath(QString pathName, int lineNo, const DbgAddr& address
 	    break;
 	}
     }
+    if (!fw) {
+	// the same file may be known under a different name
+	QString canonicalPath = QFileInfo(pathName).canonicalFilePath();
+	for (int i = count()-1; i >= 0; i--) {
+	    if (windowAt(i)->isCanonicalPath(canonicalPath)) {
+		fw = windowAt(i);
+		break;
+	    }
+	}
+    }
     if (!fw) {
 	// not found, load it
 	fw = new SourceWindow(pathName, this);